@@ -0,0 +1,63 @@
+#include <src/cbor_decoder.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Decodes a large user list, as returned by GET /iam/users, with the
+ * json DOM and with the SAX based CborStringSetDecoder.
+ *
+ *   cbor_decode_bench [users] [iterations]
+ */
+
+using json = nlohmann::json;
+
+// The best of a few rounds, such that other load on the machine counts less.
+template<typename F>
+static double microsecondsPerRun(int iterations, F run)
+{
+    double best = 0;
+    for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            run();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        double perRun = elapsed.count() / iterations;
+        if (round == 0 || perRun < best) {
+            best = perRun;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    int users = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 50;
+
+    json list = json::array();
+    for (int i = 0; i < users; i++) {
+        list.push_back("user-" + std::to_string(i));
+    }
+    std::vector<uint8_t> cbor = json::to_cbor(list);
+
+    size_t checksum = 0;
+    double dom = microsecondsPerRun(iterations, [&]() {
+            std::set<std::string> result = json::from_cbor(cbor).get<std::set<std::string> >();
+            checksum += result.size();
+        });
+    double sax = microsecondsPerRun(iterations, [&]() {
+            std::set<std::string> result;
+            CborStringSetDecoder decoder;
+            if (decoder.decode(nabto::client::BufferView(cbor.data(), cbor.size()), result)) {
+                checksum += result.size();
+            }
+        });
+
+    std::cout << users << " users, " << cbor.size() << " bytes of CBOR, " << iterations << " iterations" << std::endl;
+    std::cout << "json::from_cbor  " << dom << " us per decode" << std::endl;
+    std::cout << "CborDecoder      " << sax << " us per decode" << std::endl;
+    return checksum == static_cast<size_t>(users) * iterations * 10 ? 0 : 1;
+}
@@ -6,6 +6,10 @@
 #include <vector>
 #include <exception>
 #include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace nabto {
 namespace client {
@@ -113,19 +117,202 @@ class Logger {
     virtual void log(LogMessage message) = 0;
 };
 
+#ifndef SWIGJAVA
+/**
+ * Runs work posted by the wrapper, e.g. future callbacks and connection
+ * event callbacks, such that application code does not run on and
+ * block the SDK threads.
+ */
+class Executor {
+ public:
+    virtual ~Executor() {}
+    virtual void post(std::function<void ()> work) = 0;
+
+    // Runs the work immediately on the posting thread, which is the SDK thread for callbacks.
+    static std::shared_ptr<Executor> createInline();
+    // Runs the work on a number of worker threads, in no particular order.
+    static std::shared_ptr<Executor> createThreadPool(size_t threads);
+    // Runs the work one at a time in the order it was posted, using the threads of another executor.
+    static std::shared_ptr<Executor> createStrand(std::shared_ptr<Executor> executor);
+};
+#endif
+
 class FutureCallback {
  public:
     virtual ~FutureCallback() { }
     virtual void run(Status status) = 0;
 };
 
+#ifndef SWIGJAVA
+/**
+ * A move only callback for the result of a future. Callables of up to
+ * INLINE_SIZE bytes, e.g. a lambda capturing a few pointers or a
+ * shared_ptr, are stored inline such that registering a callback does
+ * not allocate. Larger callables are moved to the heap.
+ */
+class StatusCallback {
+ public:
+    enum { INLINE_SIZE = 48 };
+
+    StatusCallback() {}
+
+    template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, StatusCallback>::value>::type>
+    StatusCallback(F&& f)
+    {
+        typedef typename std::decay<F>::type Fn;
+        assign<Fn>(std::forward<F>(f), std::integral_constant<bool, sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(Storage)>());
+    }
+
+    StatusCallback(StatusCallback&& other)
+    {
+        moveFrom(other);
+    }
+
+    StatusCallback& operator=(StatusCallback&& other)
+    {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    StatusCallback(const StatusCallback&) = delete;
+    StatusCallback& operator=(const StatusCallback&) = delete;
+
+    ~StatusCallback()
+    {
+        reset();
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()(Status status)
+    {
+        ops_->invoke(&storage_, status);
+    }
+
+    void reset()
+    {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+ private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type Storage;
+
+    class Ops {
+     public:
+        void (*invoke)(void* storage, Status status);
+        void (*destroy)(void* storage);
+        // move the callable from one storage to another, the source is left empty.
+        void (*move)(void* from, void* to);
+    };
+
+    template<typename Fn>
+    class InlineOps {
+     public:
+        static void invoke(void* storage, Status status) { (*static_cast<Fn*>(storage))(status); }
+        static void destroy(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+        static void move(void* from, void* to)
+        {
+            new (to) Fn(std::move(*static_cast<Fn*>(from)));
+            static_cast<Fn*>(from)->~Fn();
+        }
+        static const Ops* ops() { static const Ops o = { &invoke, &destroy, &move }; return &o; }
+    };
+
+    template<typename Fn>
+    class HeapOps {
+     public:
+        static void invoke(void* storage, Status status) { (**static_cast<Fn**>(storage))(status); }
+        static void destroy(void* storage) { delete *static_cast<Fn**>(storage); }
+        static void move(void* from, void* to) { *static_cast<Fn**>(to) = *static_cast<Fn**>(from); }
+        static const Ops* ops() { static const Ops o = { &invoke, &destroy, &move }; return &o; }
+    };
+
+    template<typename Fn, typename F>
+    void assign(F&& f, std::true_type /*fits inline*/)
+    {
+        new (&storage_) Fn(std::forward<F>(f));
+        ops_ = InlineOps<Fn>::ops();
+    }
+
+    template<typename Fn, typename F>
+    void assign(F&& f, std::false_type /*fits inline*/)
+    {
+        *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+        ops_ = HeapOps<Fn>::ops();
+    }
+
+    void moveFrom(StatusCallback& other)
+    {
+        if (other.ops_) {
+            other.ops_->move(&other.storage_, &storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    Storage storage_;
+    const Ops* ops_ = nullptr;
+};
+#endif
+
+class FutureVoid;
+class FutureSize;
+
 class Future {
  public:
     virtual ~Future() {}
 
     virtual void callback(std::shared_ptr<FutureCallback> cb) = 0;
+
+    /**
+     * Wait at most the given number of milliseconds for the future to
+     * resolve. Returns true if the future is resolved, the result can
+     * then be retrieved with getResult().
+     */
+    virtual bool waitFor(int milliseconds) = 0;
 #ifndef SWIGJAVA
     void callback(std::function<void (Status status)> cb);
+
+    /**
+     * Run the callback on the given executor instead of the executor
+     * of the context. Without an executor on the context callbacks run
+     * on the SDK thread.
+     */
+    void callback(std::shared_ptr<FutureCallback> cb, std::shared_ptr<Executor> executor);
+    void callback(std::function<void (Status status)> cb, std::shared_ptr<Executor> executor);
+
+    /**
+     * The callback is stored in the future itself, so a small callable
+     * costs no allocation. The other callback variants forward here.
+     * Without an executor the callback runs on the executor of the
+     * context.
+     */
+    virtual void onResult(StatusCallback cb, std::shared_ptr<Executor> executor) = 0;
+
+    /**
+     * Combinators, resolved from the callbacks of the futures they
+     * combine such that no thread waits. They take the callback of the
+     * futures given to them. Callbacks on the combined futures run on
+     * the thread which resolved them unless an executor is given.
+     */
+    typedef std::function<void ()> Canceller;
+
+    // Run next when this future resolves. The result resolves with the status of the future next returns, or with the status of this future if next returns nullptr, or fails if next throws.
+    std::shared_ptr<FutureVoid> then(std::function<std::shared_ptr<Future> (Status status)> next);
+    // Resolves when all the futures are resolved, with the first error if any failed.
+    static std::shared_ptr<FutureVoid> whenAll(std::vector<std::shared_ptr<Future> > futures);
+    // Resolves with the index of the first future to resolve ok and calls the cancellers of the unresolved futures, fails with the last error if none resolve ok.
+    static std::shared_ptr<FutureSize> whenAny(std::vector<std::shared_ptr<Future> > futures, std::vector<Canceller> cancellers = std::vector<Canceller>());
+    // Resolves ok after the given time.
+    static std::shared_ptr<FutureVoid> timer(int milliseconds);
+    // Resolves with the status of the future, or TIMEOUT in which case the canceller is called.
+    static std::shared_ptr<FutureVoid> withTimeout(std::shared_ptr<Future> future, int milliseconds, Canceller cancel = nullptr);
 #endif
 };
 
@@ -144,6 +331,31 @@ class FutureBuffer : public Future {
     virtual std::vector<uint8_t> getResult() = 0;
 };
 
+// Resolves with the number of bytes transferred to or from a caller owned buffer.
+class FutureSize : public Future {
+ public:
+    virtual ~FutureSize() {}
+    virtual size_t waitForResult() = 0;
+    virtual size_t getResult() = 0;
+};
+
+#ifndef SWIGJAVA
+/**
+ * A FutureVoid resolved by the application, e.g. to expose an operation
+ * made of several requests as one future which combines with the SDK
+ * futures. Callbacks run on the resolving thread unless an executor is
+ * given.
+ */
+class PromiseVoid {
+ public:
+    virtual ~PromiseVoid() {}
+    static std::shared_ptr<PromiseVoid> create();
+    virtual std::shared_ptr<FutureVoid> getFuture() = 0;
+    // Returns false if the promise was already resolved.
+    virtual bool resolve(Status status) = 0;
+};
+#endif
+
 
 
 class MdnsResult {
@@ -177,6 +389,26 @@ class MdnsResolver {
     virtual void stop() = 0;
 };
 
+#ifndef SWIGJAVA
+/**
+ * A non owning view of a buffer owned by the SDK, e.g. the payload of
+ * a coap response. The view is only valid as long as its owner.
+ */
+class BufferView {
+ public:
+    BufferView() {}
+    BufferView(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+ private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+#endif
+
 class Coap {
  public:
     virtual ~Coap() {};
@@ -185,6 +417,13 @@ class Coap {
     virtual int getResponseStatusCode() = 0;
     virtual int getResponseContentFormat() = 0;
     virtual std::vector<uint8_t> getResponsePayload() = 0;
+#ifndef SWIGJAVA
+    /**
+     * The response payload without a copy, valid for the lifetime of
+     * the Coap object. Empty if the response has no payload.
+     */
+    virtual BufferView getResponsePayloadView() = 0;
+#endif
 };
 
 class Stream {
@@ -193,7 +432,28 @@ class Stream {
     virtual std::shared_ptr<FutureVoid> open(uint32_t contentType) = 0;
     virtual std::shared_ptr<FutureBuffer> readAll(size_t n) = 0;
     virtual std::shared_ptr<FutureBuffer> readSome(size_t max) = 0;
+
+    /**
+     * Read directly into a caller owned buffer without allocating or
+     * copying. The buffer must stay valid until the future is
+     * resolved, the future resolves with the number of bytes read.
+     */
+    virtual std::shared_ptr<FutureSize> readAll(uint8_t* buffer, size_t n) = 0;
+    virtual std::shared_ptr<FutureSize> readSome(uint8_t* buffer, size_t max) = 0;
     virtual std::shared_ptr<FutureVoid> write(const std::vector<uint8_t>& buffer) = 0;
+#ifndef SWIGJAVA
+    // Write a buffer the stream takes ownership of, it is not copied.
+    virtual std::shared_ptr<FutureVoid> write(std::vector<uint8_t>&& buffer) = 0;
+#endif
+    // Write a caller owned buffer without copying it, the buffer must stay valid until the future is resolved.
+    virtual std::shared_ptr<FutureVoid> write(const uint8_t* buffer, size_t size) = 0;
+    /**
+     * Write several buffers in order as one write, e.g. a header and a
+     * body, without concatenating them. The future resolves when all
+     * buffers are written or with the error of the first failing
+     * buffer.
+     */
+    virtual std::shared_ptr<FutureVoid> writeVectored(std::vector<std::vector<uint8_t> > buffers) = 0;
     virtual std::shared_ptr<FutureVoid> close() = 0;
     virtual void abort() = 0;
 };
@@ -250,8 +510,18 @@ class Connection {
     virtual void addDirectCandidate(const std::string& hostname, uint16_t port) = 0;
     virtual void endOfDirectCandidates() = 0;
 
+    /**
+     * Listeners can be added and removed from within an event callback.
+     * Events are posted to the events executor of the connection, else
+     * the executor of the context, else delivered on the SDK thread.
+     * Use an executor which runs work in order, e.g. a strand, to keep
+     * the events in order.
+     */
     virtual void addEventsListener(std::shared_ptr<ConnectionEventsCallback> callback) = 0;
     virtual void removeEventsListener(std::shared_ptr<ConnectionEventsCallback> callback) = 0;
+#ifndef SWIGJAVA
+    virtual void setEventsExecutor(std::shared_ptr<Executor> executor) = 0;
+#endif
 
     virtual std::shared_ptr<FutureVoid> connect() = 0;
     virtual std::shared_ptr<Stream> createStream() = 0;
@@ -271,6 +541,10 @@ class Context {
     virtual void setLogger(std::shared_ptr<Logger> logger) = 0;
     virtual void setLogLevel(const std::string& level) = 0;
     virtual std::string createPrivateKey() = 0;
+#ifndef SWIGJAVA
+    // The executor future callbacks and connection events of this context are posted to.
+    virtual void setExecutor(std::shared_ptr<Executor> executor) = 0;
+#endif
     static std::string version();
 #ifdef __ANDROID__
     virtual void setAndroidWifiNetworkHandle(uint64_t handle) = 0;
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "nabto_client.hpp"
+
+/**
+ * C++20 coroutine support for the wrapper futures, enabled with the
+ * NABTO_CLIENT_COROUTINES cmake option. FutureVoid, FutureBuffer,
+ * FutureSize and FutureMdnsResult can be co_awaited, the coroutine is
+ * suspended until the future resolves and the result or a
+ * NabtoException is returned from the co_await.
+ *
+ * The coroutine resumes on the executor of the context, or on the SDK
+ * thread if the context has no executor, use resumeOn to pick another
+ * executor. A coroutine resumed on the SDK thread must not block, e.g.
+ * with waitForResult, as that stalls the SDK.
+ *
+ *   Task<bool> pair(std::shared_ptr<Connection> connection)
+ *   {
+ *       co_await connection->connect();
+ *       auto coap = connection->createCoap("POST", "/iam/pairing/local-initial");
+ *       co_await coap->execute();
+ *       co_return coap->getResponseStatusCode() == 201;
+ *   }
+ *
+ * The edge_tunnel_client flows do not use this header, the tool is
+ * built as C++14 and its pairing and connect flows stay blocking.
+ */
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && !defined(SWIGJAVA)
+
+#define NABTO_CLIENT_HAS_COROUTINES 1
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+
+namespace nabto {
+namespace client {
+
+template<typename F>
+class FutureAwaiter {
+ public:
+    FutureAwaiter(std::shared_ptr<F> future, std::shared_ptr<Executor> executor)
+        : future_(std::move(future)), executor_(std::move(executor))
+    {
+    }
+
+    // false on the SDK callback thread, where the SDK refuses to wait, the coroutine then suspends.
+    bool await_ready()
+    {
+        return future_->waitFor(0);
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        future_->onResult([handle](Status) { handle.resume(); }, executor_);
+    }
+
+    // Throws a NabtoException if the future failed.
+    auto await_resume()
+    {
+        return future_->getResult();
+    }
+
+ private:
+    std::shared_ptr<F> future_;
+    std::shared_ptr<Executor> executor_;
+};
+
+inline FutureAwaiter<FutureVoid> operator co_await(std::shared_ptr<FutureVoid> future)
+{
+    return FutureAwaiter<FutureVoid>(std::move(future), nullptr);
+}
+
+inline FutureAwaiter<FutureBuffer> operator co_await(std::shared_ptr<FutureBuffer> future)
+{
+    return FutureAwaiter<FutureBuffer>(std::move(future), nullptr);
+}
+
+inline FutureAwaiter<FutureSize> operator co_await(std::shared_ptr<FutureSize> future)
+{
+    return FutureAwaiter<FutureSize>(std::move(future), nullptr);
+}
+
+inline FutureAwaiter<FutureMdnsResult> operator co_await(std::shared_ptr<FutureMdnsResult> future)
+{
+    return FutureAwaiter<FutureMdnsResult>(std::move(future), nullptr);
+}
+
+// co_await resumeOn(future, executor) resumes the coroutine on the given executor.
+template<typename F>
+FutureAwaiter<F> resumeOn(std::shared_ptr<F> future, std::shared_ptr<Executor> executor)
+{
+    return FutureAwaiter<F>(std::move(future), std::move(executor));
+}
+
+template<typename T>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+ public:
+    typedef std::function<void (std::exception_ptr error)> DoneCallback;
+
+    class FinalAwaiter {
+     public:
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.continuation_) {
+                return promise.continuation_;
+            }
+            // the callback is moved out as a detached task frees itself before it is called.
+            DoneCallback done = std::move(promise.done_);
+            std::exception_ptr error = promise.error_;
+            if (promise.detached_) {
+                handle.destroy();
+            }
+            if (done) {
+                done(error);
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    // Tasks are lazy, they run when they are awaited or started.
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error_ = std::current_exception(); }
+
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr error_;
+    bool detached_ = false;
+    DoneCallback done_;
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+    Task<T> get_return_object();
+    void return_value(T value) { value_.emplace(std::move(value)); }
+
+    T result()
+    {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value_);
+    }
+
+    std::optional<T> value_;
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void result()
+    {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * A coroutine returning T. A task runs when it is co_awaited from
+ * another coroutine, or when it is started from plain code, and it
+ * continues on the thread which resumed it last.
+ */
+template<typename T = void>
+class Task {
+ public:
+    typedef detail::TaskPromise<T> promise_type;
+    typedef detail::TaskPromiseBase::DoneCallback DoneCallback;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { reset(); }
+
+    class Awaiter {
+     public:
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation)
+        {
+            handle_.promise().continuation_ = continuation;
+            return handle_;
+        }
+        T await_resume() { return handle_.promise().result(); }
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    Awaiter operator co_await() && { return Awaiter{handle_}; }
+
+    /**
+     * Run the task without waiting for it, the task frees itself when
+     * it is done and then calls done with the exception it ended with,
+     * if any. The result of the task is discarded.
+     */
+    void start(DoneCallback done = nullptr)
+    {
+        auto handle = std::exchange(handle_, nullptr);
+        handle.promise().detached_ = true;
+        handle.promise().done_ = std::move(done);
+        handle.resume();
+    }
+
+    /**
+     * Run the task and block until it is done, for calling a coroutine
+     * from blocking code. Must not be called from the SDK thread.
+     */
+    T wait()
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        handle_.promise().done_ = [&mutex, &cond, &done](std::exception_ptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            cond.notify_all();
+        };
+        handle_.resume();
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&done]() { return done; });
+        return handle_.promise().result();
+    }
+
+ private:
+    void reset()
+    {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+
+} // namespace detail
+
+} } // namespace
+
+#endif
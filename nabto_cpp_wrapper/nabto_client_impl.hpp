@@ -9,7 +9,11 @@
 
 #include <thread>
 #include <mutex>
-#include <set>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <array>
+#include <algorithm>
 
 namespace nabto {
 namespace client {
@@ -60,24 +64,471 @@ bool Status::ok() const {
     return errorCode_ == 0;
 }
 
-class FutureBufferImpl : public FutureBuffer, public std::enable_shared_from_this<FutureBufferImpl>
+class InlineExecutorImpl : public Executor {
+ public:
+    void post(std::function<void ()> work) {
+        work();
+    }
+};
+
+class ThreadPoolExecutorImpl : public Executor {
+ public:
+    ThreadPoolExecutorImpl(size_t threads)
+        : state_(std::make_shared<State>())
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, threads); i++) {
+            auto state = state_;
+            threads_.push_back(std::thread([state](){ run(state); }));
+        }
+    }
+    ~ThreadPoolExecutorImpl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex_);
+            state_->stopped_ = true;
+        }
+        state_->cond_.notify_all();
+        for (auto& t : threads_) {
+            if (t.get_id() == std::this_thread::get_id()) {
+                // the last reference was dropped by work running on the
+                // pool, the thread keeps the state alive until it ends.
+                t.detach();
+            } else {
+                t.join();
+            }
+        }
+    }
+    void post(std::function<void ()> work)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex_);
+            state_->queue_.push_back(std::move(work));
+        }
+        state_->cond_.notify_one();
+    }
+ private:
+    // Owned by the pool and each of its threads.
+    class State {
+     public:
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<std::function<void ()> > queue_;
+        bool stopped_ = false;
+    };
+
+    static void run(std::shared_ptr<State> state)
+    {
+        std::unique_lock<std::mutex> lock(state->mutex_);
+        for (;;) {
+            state->cond_.wait(lock, [&state](){ return state->stopped_ || !state->queue_.empty(); });
+            // queued work is finished before the threads stop.
+            if (state->queue_.empty()) {
+                return;
+            }
+            std::function<void ()> work = std::move(state->queue_.front());
+            state->queue_.pop_front();
+            lock.unlock();
+            work();
+            // drop the captures of the work outside the lock, they may own the pool.
+            work = nullptr;
+            lock.lock();
+        }
+    }
+    std::shared_ptr<State> state_;
+    std::vector<std::thread> threads_;
+};
+
+class StrandImpl : public Executor, public std::enable_shared_from_this<StrandImpl> {
+ public:
+    StrandImpl(std::shared_ptr<Executor> executor)
+        : executor_(executor)
+    {
+    }
+    void post(std::function<void ()> work)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(work));
+            if (running_) {
+                return;
+            }
+            running_ = true;
+        }
+        auto self = shared_from_this();
+        executor_->post([self](){ self->drain(); });
+    }
+ private:
+    void drain()
+    {
+        for (;;) {
+            std::function<void ()> work;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (queue_.empty()) {
+                    running_ = false;
+                    return;
+                }
+                work = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            work();
+        }
+    }
+    std::shared_ptr<Executor> executor_;
+    std::mutex mutex_;
+    std::deque<std::function<void ()> > queue_;
+    bool running_ = false;
+};
+
+std::shared_ptr<Executor> Executor::createInline()
+{
+    return std::make_shared<InlineExecutorImpl>();
+}
+
+std::shared_ptr<Executor> Executor::createThreadPool(size_t threads)
 {
+    return std::make_shared<ThreadPoolExecutorImpl>(threads);
+}
+
+std::shared_ptr<Executor> Executor::createStrand(std::shared_ptr<Executor> executor)
+{
+    return std::make_shared<StrandImpl>(executor);
+}
+
+/**
+ * A free list of memory blocks of one size shared by all objects of
+ * that size. At most MAX_FREE blocks are kept, the rest are returned to
+ * the heap. The list is never destroyed such that objects freed during
+ * static destruction still have a list to return to.
+ */
+template<size_t Size>
+class FreeList {
  public:
-    FutureBufferImpl(NabtoClient* context, std::shared_ptr<std::vector<uint8_t> > data, std::shared_ptr<size_t> transferred)
-        : future_(nabto_client_future_new(context)), data_(data), transferred_(transferred)
+    static FreeList& instance()
+    {
+        static FreeList* list = new FreeList();
+        return *list;
+    }
+    void* pop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (head_) {
+                Node* n = head_;
+                head_ = n->next_;
+                count_--;
+                return n;
+            }
+        }
+        return ::operator new(Size < sizeof(Node) ? sizeof(Node) : Size);
+    }
+    void push(void* block)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (count_ < MAX_FREE) {
+                Node* n = static_cast<Node*>(block);
+                n->next_ = head_;
+                head_ = n;
+                count_++;
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+ private:
+    enum { MAX_FREE = 256 };
+    class Node {
+     public:
+        Node* next_;
+    };
+    std::mutex mutex_;
+    Node* head_ = nullptr;
+    size_t count_ = 0;
+};
+
+/**
+ * Allocator for std::allocate_shared which recycles the blocks of
+ * single objects through a FreeList, such that the future objects and
+ * their control blocks are not allocated per operation.
+ */
+template<typename T>
+class PoolAllocator {
+ public:
+    typedef T value_type;
+    PoolAllocator() {}
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1) {
+            return static_cast<T*>(FreeList<sizeof(T)>::instance().pop());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n)
+    {
+        if (n == 1) {
+            FreeList<sizeof(T)>::instance().push(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+template<typename T, typename... Args>
+static std::shared_ptr<T> makePooled(Args&&... args)
+{
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+/**
+ * Recycles the SDK future handles of a context, an SDK future can be
+ * reused once it has resolved. The pool is closed before the context
+ * is freed, handles released after that are freed directly.
+ */
+class FutureHandlePool {
+ public:
+    FutureHandlePool(NabtoClient* context)
+        : context_(context)
+    {
+        free_.reserve(MAX_FREE);
+    }
+    ~FutureHandlePool()
+    {
+        close();
+    }
+    NabtoClientFuture* acquire()
     {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                NabtoClientFuture* future = free_.back();
+                free_.pop_back();
+                return future;
+            }
+        }
+        return nabto_client_future_new(context_);
     }
-    FutureBufferImpl(NabtoClientFuture* future, std::shared_ptr<std::vector<uint8_t> > data, std::shared_ptr<size_t> transferred)
-        : future_(future), data_(data), transferred_(transferred)
+    void release(NabtoClientFuture* future)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!closed_ && free_.size() < MAX_FREE) {
+                free_.push_back(future);
+                return;
+            }
+        }
+        nabto_client_future_free(future);
+    }
+    void close()
+    {
+        std::vector<NabtoClientFuture*> free;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            free.swap(free_);
+        }
+        for (auto f : free) {
+            nabto_client_future_free(f);
+        }
+    }
+ private:
+    enum { MAX_FREE = 64 };
+    NabtoClient* context_;
+    std::mutex mutex_;
+    std::vector<NabtoClientFuture*> free_;
+    bool closed_ = false;
+};
+
+/**
+ * The executor and the future handle pool of each context. The futures
+ * only know the NabtoClient of their context, they look up the
+ * resources when they are created. The map is copy on write and read
+ * with std::atomic_load.
+ */
+class ContextResources {
+ public:
+    class Entry {
+     public:
+        NabtoClientFuture* newFuture(NabtoClient* context)
+        {
+            return handles_ ? handles_->acquire() : nabto_client_future_new(context);
+        }
+        void freeFuture(NabtoClientFuture* future)
+        {
+            if (handles_) {
+                handles_->release(future);
+            } else {
+                nabto_client_future_free(future);
+            }
+        }
+        std::shared_ptr<Executor> executor_;
+        std::shared_ptr<FutureHandlePool> handles_;
+    };
+
+    static Entry get(NabtoClient* context)
+    {
+        auto resources = std::atomic_load(&map());
+        if (!resources) {
+            return Entry();
+        }
+        auto it = resources->find(context);
+        return it == resources->end() ? Entry() : it->second;
+    }
+    static void setExecutor(NabtoClient* context, std::shared_ptr<Executor> executor)
+    {
+        update(context, [executor](Map& m, NabtoClient* c){ m[c].executor_ = executor; });
+    }
+    static void setHandles(NabtoClient* context, std::shared_ptr<FutureHandlePool> handles)
+    {
+        update(context, [handles](Map& m, NabtoClient* c){ m[c].handles_ = handles; });
+    }
+    static void remove(NabtoClient* context)
+    {
+        update(context, [](Map& m, NabtoClient* c){ m.erase(c); });
+    }
+ private:
+    typedef std::map<NabtoClient*, Entry> Map;
+    template<typename F>
+    static void update(NabtoClient* context, F change)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto current = std::atomic_load(&map());
+        auto next = current ? std::make_shared<Map>(*current) : std::make_shared<Map>();
+        change(*next, context);
+        std::atomic_store(&map(), std::shared_ptr<const Map>(next));
+    }
+    static std::shared_ptr<const Map>& map() { static std::shared_ptr<const Map> m; return m; }
+    static std::mutex& mutex() { static std::mutex m; return m; }
+};
+
+/**
+ * A future object which is freed before its SDK future resolved. The
+ * SDK future is returned to the pool when it resolves, and the buffers
+ * the SDK writes to are kept alive until then. An mdns result the SDK
+ * writes to the slot is freed as nobody will take it.
+ */
+class DetachedFuture {
+ public:
+    static void detach(const ContextResources::Entry& resources, NabtoClientFuture* future, std::shared_ptr<void> data, std::shared_ptr<void> transferred, std::shared_ptr<NabtoClientMdnsResult*> mdnsResult = nullptr)
+    {
+        DetachedFuture* d = PoolAllocator<DetachedFuture>().allocate(1);
+        new (d) DetachedFuture();
+        d->handles_ = resources.handles_;
+        d->data_ = std::move(data);
+        d->transferred_ = std::move(transferred);
+        d->mdnsResult_ = std::move(mdnsResult);
+        nabto_client_future_set_callback(future, &resolved, d);
+    }
+ private:
+    static void resolved(NabtoClientFuture* future, NabtoClientError, void* data)
+    {
+        DetachedFuture* d = (DetachedFuture*)data;
+        if (d->mdnsResult_ && *d->mdnsResult_) {
+            nabto_client_mdns_result_free(*d->mdnsResult_);
+        }
+        ContextResources::Entry resources;
+        resources.handles_ = d->handles_;
+        resources.freeFuture(future);
+        d->~DetachedFuture();
+        PoolAllocator<DetachedFuture>().deallocate(d, 1);
+    }
+    std::shared_ptr<FutureHandlePool> handles_;
+    std::shared_ptr<void> data_;
+    std::shared_ptr<void> transferred_;
+    std::shared_ptr<NabtoClientMdnsResult*> mdnsResult_;
+};
+
+// Used by the wrapper to continue on the resolving thread regardless of the executor of the context.
+static std::shared_ptr<Executor> inlineExecutor()
+{
+    static std::shared_ptr<Executor> executor = std::make_shared<InlineExecutorImpl>();
+    return executor;
+}
+
+/**
+ * Runs the timers of the wrapper on one thread shared by all timers,
+ * started with the first timer. The queue is never destroyed such that
+ * the thread can outlive static destruction.
+ */
+class TimerQueue {
+ public:
+    static TimerQueue& instance()
+    {
+        static TimerQueue* queue = new TimerQueue();
+        return *queue;
+    }
+    void schedule(std::chrono::steady_clock::time_point when, std::function<void ()> work)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timers_.insert(std::make_pair(when, std::move(work)));
+            if (!started_) {
+                started_ = true;
+                std::thread([this](){ run(); }).detach();
+            }
+        }
+        cond_.notify_one();
+    }
+ private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            if (timers_.empty()) {
+                cond_.wait(lock);
+                continue;
+            }
+            auto first = timers_.begin();
+            if (first->first > std::chrono::steady_clock::now()) {
+                cond_.wait_until(lock, first->first);
+                continue;
+            }
+            std::function<void ()> work = std::move(first->second);
+            timers_.erase(first);
+            lock.unlock();
+            work();
+            lock.lock();
+        }
+    }
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void ()> > timers_;
+    bool started_ = false;
+};
+
+// Run a future callback on the executor, or directly if there is none. keepAlive holds the future until the callback has run.
+static void dispatchCallback(const std::shared_ptr<Executor>& executor, StatusCallback& cb, std::shared_ptr<void> keepAlive, NabtoClientError ec)
+{
+    if (executor) {
+        // the posted work has to be copyable, the executor path allocates anyway.
+        auto shared = std::make_shared<StatusCallback>(std::move(cb));
+        executor->post([shared, keepAlive, ec](){ (*shared)(Status(ec)); });
+    } else {
+        cb(Status(ec));
+    }
+}
+
+class FutureBufferImpl : public FutureBuffer, public std::enable_shared_from_this<FutureBufferImpl>
+{
+ public:
+    FutureBufferImpl(NabtoClient* context, std::shared_ptr<std::vector<uint8_t> > data, std::shared_ptr<size_t> transferred)
+        : resources_(ContextResources::get(context)), future_(resources_.newFuture(context)), data_(data), transferred_(transferred)
     {
     }
     ~FutureBufferImpl()
     {
         if (!ended_) {
-            auto c = std::make_shared<FutureBufferImpl>(future_, data_, transferred_);
-            c->callback(std::make_shared<CallbackFunction>([](Status){ /* do nothing */ }));
+            DetachedFuture::detach(resources_, future_, data_, transferred_);
         } else {
-            nabto_client_future_free(future_);
+            resources_.freeFuture(future_);
         }
     }
 
@@ -87,16 +538,34 @@ class FutureBufferImpl : public FutureBuffer, public std::enable_shared_from_thi
         ended_ = true;
         return getResult();
     }
-    static void doCallback(NabtoClientFuture* future, NabtoClientError ec, void* data)
+    bool waitFor(int milliseconds)
+    {
+        NabtoClientError ec = nabto_client_future_timed_wait(future_, milliseconds);
+        // COULD_BLOCK on the SDK callback thread tells nothing about the future.
+        if (ec == NABTO_CLIENT_EC_FUTURE_NOT_RESOLVED || ec == NABTO_CLIENT_EC_COULD_BLOCK) {
+            return false;
+        }
+        ended_ = true;
+        return true;
+    }
+    static void doCallback(NabtoClientFuture*, NabtoClientError ec, void* data)
     {
         FutureBufferImpl* self = (FutureBufferImpl*)data;
         self->ended_ = true;
-        self->cb_->run(Status(ec));
-        self->selfReference_ = nullptr;
+        std::shared_ptr<FutureBufferImpl> keepAlive;
+        keepAlive.swap(self->selfReference_);
+        dispatchCallback(self->resources_.executor_, self->cb_, std::move(keepAlive), ec);
     }
     void callback(std::shared_ptr<FutureCallback> cb)
     {
-        cb_ = cb;
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        if (executor) {
+            resources_.executor_ = executor;
+        }
+        cb_ = std::move(cb);
         selfReference_ = shared_from_this();
         nabto_client_future_set_callback(future_,
                                          &doCallback,
@@ -114,11 +583,261 @@ class FutureBufferImpl : public FutureBuffer, public std::enable_shared_from_thi
         return future_;
     }
   private:
+    ContextResources::Entry resources_;
     NabtoClientFuture* future_;
     std::shared_ptr<std::vector<uint8_t> > data_;
     std::shared_ptr<size_t> transferred_;
     std::shared_ptr<FutureBufferImpl> selfReference_;
-    std::shared_ptr<FutureCallback> cb_;
+    StatusCallback cb_;
+    bool ended_ = false;
+};
+
+
+/**
+ * The state of a future which is resolved by the wrapper instead of by
+ * an SDK future, used for operations made of several SDK calls and by
+ * the future combinators.
+ */
+class PromiseState {
+ public:
+    PromiseState(std::shared_ptr<Executor> executor)
+        : executor_(executor)
+    {
+    }
+
+    // Returns false if the promise was already resolved. keepAlive holds the future until its callback has run.
+    bool resolve(NabtoClientError ec, std::shared_ptr<void> keepAlive)
+    {
+        StatusCallback cb;
+        std::shared_ptr<Executor> executor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (resolved_) {
+                return false;
+            }
+            resolved_ = true;
+            ec_ = ec;
+            cb = std::move(cb_);
+            executor = executor_;
+        }
+        cond_.notify_all();
+        if (cb) {
+            dispatchCallback(executor, cb, std::move(keepAlive), ec);
+        }
+        return true;
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this](){ return resolved_; });
+    }
+    bool waitFor(int milliseconds)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, std::chrono::milliseconds(milliseconds), [this](){ return resolved_; });
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor, std::shared_ptr<void> keepAlive)
+    {
+        NabtoClientError ec;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (executor) {
+                executor_ = executor;
+            }
+            if (!resolved_) {
+                cb_ = std::move(cb);
+                return;
+            }
+            ec = ec_;
+            executor = executor_;
+        }
+        dispatchCallback(executor, cb, std::move(keepAlive), ec);
+    }
+    // Throws if the promise is not resolved or resolved with an error.
+    void check()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!resolved_) {
+            throw NabtoException(NABTO_CLIENT_EC_FUTURE_NOT_RESOLVED);
+        }
+        if (ec_) {
+            throw NabtoException(ec_);
+        }
+    }
+ private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool resolved_ = false;
+    NabtoClientError ec_ = NABTO_CLIENT_EC_OK;
+    StatusCallback cb_;
+    std::shared_ptr<Executor> executor_;
+};
+
+class FutureVoidPromiseImpl : public FutureVoid, public std::enable_shared_from_this<FutureVoidPromiseImpl>
+{
+ public:
+    // A nullptr context delivers the callbacks on the resolving thread unless an executor is given.
+    FutureVoidPromiseImpl(NabtoClient* context)
+        : state_(ContextResources::get(context).executor_)
+    {
+    }
+
+    bool resolve(NabtoClientError ec)
+    {
+        return state_.resolve(ec, shared_from_this());
+    }
+
+    void waitForResult()
+    {
+        state_.wait();
+        getResult();
+    }
+    bool waitFor(int milliseconds)
+    {
+        return state_.waitFor(milliseconds);
+    }
+    void callback(std::shared_ptr<FutureCallback> cb)
+    {
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        state_.onResult(std::move(cb), executor, shared_from_this());
+    }
+    void getResult()
+    {
+        state_.check();
+    }
+ private:
+    PromiseState state_;
+};
+
+class FutureSizePromiseImpl : public FutureSize, public std::enable_shared_from_this<FutureSizePromiseImpl>
+{
+ public:
+    FutureSizePromiseImpl(NabtoClient* context)
+        : state_(ContextResources::get(context).executor_)
+    {
+    }
+
+    bool resolve(NabtoClientError ec, size_t value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ec && !hasValue_) {
+                value_ = value;
+                hasValue_ = true;
+            }
+        }
+        return state_.resolve(ec, shared_from_this());
+    }
+
+    size_t waitForResult()
+    {
+        state_.wait();
+        return getResult();
+    }
+    bool waitFor(int milliseconds)
+    {
+        return state_.waitFor(milliseconds);
+    }
+    void callback(std::shared_ptr<FutureCallback> cb)
+    {
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        state_.onResult(std::move(cb), executor, shared_from_this());
+    }
+    size_t getResult()
+    {
+        state_.check();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return value_;
+    }
+ private:
+    PromiseState state_;
+    std::mutex mutex_;
+    size_t value_ = 0;
+    bool hasValue_ = false;
+};
+
+class FutureSizeImpl : public FutureSize, public std::enable_shared_from_this<FutureSizeImpl>
+{
+ public:
+    FutureSizeImpl(NabtoClient* context)
+        : resources_(ContextResources::get(context)), future_(resources_.newFuture(context)), transferred_(makePooled<size_t>(0))
+    {
+    }
+    ~FutureSizeImpl()
+    {
+        if (!ended_) {
+            // the SDK writes the count when the future resolves, so the detached future keeps it.
+            DetachedFuture::detach(resources_, future_, nullptr, transferred_);
+        } else {
+            resources_.freeFuture(future_);
+        }
+    }
+
+    size_t waitForResult()
+    {
+        nabto_client_future_wait(future_);
+        ended_ = true;
+        return getResult();
+    }
+    bool waitFor(int milliseconds)
+    {
+        NabtoClientError ec = nabto_client_future_timed_wait(future_, milliseconds);
+        // COULD_BLOCK on the SDK callback thread tells nothing about the future.
+        if (ec == NABTO_CLIENT_EC_FUTURE_NOT_RESOLVED || ec == NABTO_CLIENT_EC_COULD_BLOCK) {
+            return false;
+        }
+        ended_ = true;
+        return true;
+    }
+    static void doCallback(NabtoClientFuture*, NabtoClientError ec, void* data)
+    {
+        FutureSizeImpl* self = (FutureSizeImpl*)data;
+        self->ended_ = true;
+        std::shared_ptr<FutureSizeImpl> keepAlive;
+        keepAlive.swap(self->selfReference_);
+        dispatchCallback(self->resources_.executor_, self->cb_, std::move(keepAlive), ec);
+    }
+    void callback(std::shared_ptr<FutureCallback> cb)
+    {
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        if (executor) {
+            resources_.executor_ = executor;
+        }
+        cb_ = std::move(cb);
+        selfReference_ = shared_from_this();
+        nabto_client_future_set_callback(future_,
+                                         &doCallback,
+                                         this);
+    }
+    size_t getResult() {
+        auto ec = nabto_client_future_error_code(future_);
+        if (ec) {
+            throw NabtoException(ec);
+        }
+        return *transferred_;
+    }
+    NabtoClientFuture* getFuture() {
+        return future_;
+    }
+    size_t* getTransferred() {
+        return transferred_.get();
+    }
+  private:
+    ContextResources::Entry resources_;
+    NabtoClientFuture* future_;
+    std::shared_ptr<size_t> transferred_;
+    std::shared_ptr<FutureSizeImpl> selfReference_;
+    StatusCallback cb_;
     bool ended_ = false;
 };
 
@@ -177,20 +896,19 @@ class FutureMdnsResultImpl : public FutureMdnsResult, public std::enable_shared_
 {
  public:
     FutureMdnsResultImpl(NabtoClient* context)
-        : future_(nabto_client_future_new(context))
-    {
-    }
-    FutureMdnsResultImpl(NabtoClientFuture* future)
-        : future_(future)
+        : resources_(ContextResources::get(context)), future_(resources_.newFuture(context)), result_(makePooled<NabtoClientMdnsResult*>(nullptr))
     {
     }
     ~FutureMdnsResultImpl()
     {
         if (!ended_) {
-            auto c = std::make_shared<FutureMdnsResultImpl>(future_);
-            c->callback(std::make_shared<CallbackFunction>([](Status){ /* do nothing */ }));
+            // the SDK writes the result to the slot after this object is gone.
+            DetachedFuture::detach(resources_, future_, nullptr, nullptr, result_);
         } else {
-            nabto_client_future_free(future_);
+            if (*result_) {
+                nabto_client_mdns_result_free(*result_);
+            }
+            resources_.freeFuture(future_);
         }
     }
 
@@ -200,17 +918,35 @@ class FutureMdnsResultImpl : public FutureMdnsResult, public std::enable_shared_
         ended_ = true;
         return getResult();
     }
-    static void doCallback(NabtoClientFuture* future, NabtoClientError ec, void* data)
+    bool waitFor(int milliseconds)
+    {
+        NabtoClientError ec = nabto_client_future_timed_wait(future_, milliseconds);
+        // COULD_BLOCK on the SDK callback thread tells nothing about the future.
+        if (ec == NABTO_CLIENT_EC_FUTURE_NOT_RESOLVED || ec == NABTO_CLIENT_EC_COULD_BLOCK) {
+            return false;
+        }
+        ended_ = true;
+        return true;
+    }
+    static void doCallback(NabtoClientFuture*, NabtoClientError ec, void* data)
     {
         FutureMdnsResultImpl* self = (FutureMdnsResultImpl*)data;
         self->ended_ = true;
-        self->cb_->run(Status(ec));
-        self->selfReference_ = nullptr;
+        std::shared_ptr<FutureMdnsResultImpl> keepAlive;
+        keepAlive.swap(self->selfReference_);
+        dispatchCallback(self->resources_.executor_, self->cb_, std::move(keepAlive), ec);
     }
 
     void callback(std::shared_ptr<FutureCallback> cb)
     {
-        cb_ = cb;
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        if (executor) {
+            resources_.executor_ = executor;
+        }
+        cb_ = std::move(cb);
         selfReference_ = shared_from_this();
         nabto_client_future_set_callback(future_,
                                          &doCallback,
@@ -221,48 +957,48 @@ class FutureMdnsResultImpl : public FutureMdnsResult, public std::enable_shared_
         if (ec) {
             throw NabtoException(ec);
         }
-        return std::make_shared<MdnsResultImpl>(result_);
+        NabtoClientMdnsResult* result = *result_;
+        if (!result) {
+            // the result was taken by an earlier call.
+            throw NabtoException(NABTO_CLIENT_EC_INVALID_STATE);
+        }
+        *result_ = nullptr;
+        return std::make_shared<MdnsResultImpl>(result);
     }
     NabtoClientFuture* getFuture() {
         return future_;
     }
-
-    NabtoClientMdnsResult* result_;
+    NabtoClientMdnsResult** getResultSlot() {
+        return result_.get();
+    }
 
   private:
+    ContextResources::Entry resources_;
     NabtoClientFuture* future_;
+    // outlives this object if it is freed before the SDK future resolved.
+    std::shared_ptr<NabtoClientMdnsResult*> result_;
     std::shared_ptr<FutureMdnsResultImpl> selfReference_;
-    std::shared_ptr<FutureCallback> cb_;
+    StatusCallback cb_;
     bool ended_ = false;
 };
 
 class FutureVoidImpl : public FutureVoid, public std::enable_shared_from_this<FutureVoidImpl> {
  public:
     FutureVoidImpl(NabtoClient* context)
-        : future_(nabto_client_future_new(context))
+        : resources_(ContextResources::get(context)), future_(resources_.newFuture(context))
     {
     }
 
     FutureVoidImpl(NabtoClient* context,  std::shared_ptr<std::vector<uint8_t> > data)
-        : future_(nabto_client_future_new(context)), data_(data)
-    {
-    }
-
-    FutureVoidImpl(NabtoClientFuture* future, std::shared_ptr<std::vector<uint8_t> > data)
-        : future_(future), data_(data)
-    {
-    }
-    FutureVoidImpl(NabtoClientFuture* future)
-        : future_(future)
+        : resources_(ContextResources::get(context)), future_(resources_.newFuture(context)), data_(data)
     {
     }
     ~FutureVoidImpl()
     {
         if (!ended_) {
-            auto c = std::make_shared<FutureVoidImpl>(future_, data_);
-            c->callback(std::make_shared<CallbackFunction>([](Status){ /* do nothing */ }));
+            DetachedFuture::detach(resources_, future_, data_, nullptr);
         } else {
-            nabto_client_future_free(future_);
+            resources_.freeFuture(future_);
         }
     }
     // waitForResult for result.
@@ -272,18 +1008,36 @@ class FutureVoidImpl : public FutureVoid, public std::enable_shared_from_this<Fu
         return getResult();
     }
 
-    static void doCallback(NabtoClientFuture* future, NabtoClientError ec, void* data)
+    static void doCallback(NabtoClientFuture*, NabtoClientError ec, void* data)
     {
         FutureVoidImpl* self = (FutureVoidImpl*)data;
         self->ended_ = true;
-        self->cb_->run(Status(ec));
-        self->selfReference_ = nullptr;
+        std::shared_ptr<FutureVoidImpl> keepAlive;
+        keepAlive.swap(self->selfReference_);
+        dispatchCallback(self->resources_.executor_, self->cb_, std::move(keepAlive), ec);
+    }
+
+    bool waitFor(int milliseconds)
+    {
+        NabtoClientError ec = nabto_client_future_timed_wait(future_, milliseconds);
+        // COULD_BLOCK on the SDK callback thread tells nothing about the future.
+        if (ec == NABTO_CLIENT_EC_FUTURE_NOT_RESOLVED || ec == NABTO_CLIENT_EC_COULD_BLOCK) {
+            return false;
+        }
+        ended_ = true;
+        return true;
     }
 
-    //bool waitFor(int milliseconds) = 0;
     void callback(std::shared_ptr<FutureCallback> cb)
     {
-        cb_ = cb;
+        onResult([cb](Status status){ cb->run(status); }, nullptr);
+    }
+    void onResult(StatusCallback cb, std::shared_ptr<Executor> executor)
+    {
+        if (executor) {
+            resources_.executor_ = executor;
+        }
+        cb_ = std::move(cb);
         selfReference_ = shared_from_this();
         nabto_client_future_set_callback(future_,
                                          &doCallback,
@@ -300,10 +1054,11 @@ class FutureVoidImpl : public FutureVoid, public std::enable_shared_from_this<Fu
         return future_;
     }
  private:
+    ContextResources::Entry resources_;
     NabtoClientFuture* future_;
     std::shared_ptr<std::vector<uint8_t> > data_;
     std::shared_ptr<FutureVoidImpl> selfReference_;
-    std::shared_ptr<FutureCallback> cb_;
+    StatusCallback cb_;
     bool ended_ = false;
 };
 
@@ -322,8 +1077,8 @@ class MdnsResolverImpl : public MdnsResolver {
     }
     virtual std::shared_ptr<FutureMdnsResult> getResult()
     {
-        auto future = std::make_shared<FutureMdnsResultImpl>(context_);
-        nabto_client_listener_new_mdns_result(resolver_, future->getFuture(), &future->result_);
+        auto future = makePooled<FutureMdnsResultImpl>(context_);
+        nabto_client_listener_new_mdns_result(resolver_, future->getFuture(), future->getResultSlot());
         return future;
     }
     virtual void stop() {
@@ -366,7 +1121,7 @@ class CoapImpl : public Coap {
 
     std::shared_ptr<FutureVoid> execute()
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_coap_execute(request_, future->getFuture());
         return future;
     }
@@ -393,16 +1148,18 @@ class CoapImpl : public Coap {
         return contentFormat;
     }
     std::vector<uint8_t> getResponsePayload() {
+        BufferView payload = getResponsePayloadView();
+        return std::vector<uint8_t>(payload.begin(), payload.end());
+    }
+    BufferView getResponsePayloadView() {
         void* payload;
         size_t payloadLength;
         NabtoClientError ec = nabto_client_coap_get_response_payload(request_, &payload, &payloadLength);
         if (ec != NABTO_CLIENT_EC_OK) {
-            return std::vector<uint8_t>();
+            return BufferView();
         }
-        const uint8_t* begin = reinterpret_cast<const uint8_t*>(payload);
-        const uint8_t* end = begin + payloadLength;
-        auto ret = std::vector<uint8_t>(begin, end);
-        return ret;
+        // the SDK owns the payload until the coap request is freed.
+        return BufferView(reinterpret_cast<const uint8_t*>(payload), payloadLength);
     }
 
  private:
@@ -411,10 +1168,114 @@ class CoapImpl : public Coap {
 };
 
 
-class StreamImpl : public Stream {
+/**
+ * Free lists of stream I/O buffers in power of two size classes. A
+ * buffer goes back to its free list when the last future using it is
+ * freed, such that steady state streaming reuses the same buffers
+ * instead of allocating a buffer, a byte counter and a shared_ptr
+ * control block per read and write. Each free list is bounded, and
+ * buffers larger than the largest class are not pooled.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
  public:
-    StreamImpl(NabtoClientConnection* connection, NabtoClient* context)
-        : context_(context)
+    class IoBuffer {
+     public:
+        std::vector<uint8_t> data_;
+        size_t transferred_ = 0;
+        size_t sizeClass_ = 0;
+    };
+
+    enum {
+        MIN_CLASS_SIZE = 256,
+        // 256 bytes to 1 MiB.
+        CLASSES = 13,
+        MAX_FREE_PER_CLASS = 16
+    };
+
+    ~BufferPool()
+    {
+        for (auto& list : free_) {
+            for (auto b : list) {
+                delete b;
+            }
+        }
+    }
+
+    // A buffer of exactly size bytes.
+    std::shared_ptr<IoBuffer> acquire(size_t size)
+    {
+        size_t c = 0;
+        size_t classSize = MIN_CLASS_SIZE;
+        while (classSize < size && c < CLASSES) {
+            classSize *= 2;
+            c++;
+        }
+        if (c == CLASSES) {
+            auto b = std::make_shared<IoBuffer>();
+            b->data_.resize(size);
+            b->sizeClass_ = CLASSES;
+            return b;
+        }
+        IoBuffer* b = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_[c].empty()) {
+                b = free_[c].back();
+                free_[c].pop_back();
+            }
+        }
+        if (!b) {
+            b = new IoBuffer();
+            b->data_.reserve(classSize);
+            b->sizeClass_ = c;
+        }
+        // within the reserved capacity, so this does not allocate.
+        b->data_.resize(size);
+        b->transferred_ = 0;
+        std::weak_ptr<BufferPool> pool = shared_from_this();
+        // the control block holding the deleter is recycled through a FreeList as well.
+        return std::shared_ptr<IoBuffer>(b, [pool](IoBuffer* b) {
+                auto p = pool.lock();
+                if (p) {
+                    p->release(b);
+                } else {
+                    delete b;
+                }
+            }, PoolAllocator<IoBuffer>());
+    }
+
+    // The data and transferred count of a buffer as separate pointers sharing its lifetime.
+    static std::shared_ptr<std::vector<uint8_t> > data(std::shared_ptr<IoBuffer> b)
+    {
+        return std::shared_ptr<std::vector<uint8_t> >(b, &b->data_);
+    }
+    static std::shared_ptr<size_t> transferred(std::shared_ptr<IoBuffer> b)
+    {
+        return std::shared_ptr<size_t>(b, &b->transferred_);
+    }
+
+ private:
+    void release(IoBuffer* b)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& list = free_[b->sizeClass_];
+            if (list.size() < MAX_FREE_PER_CLASS) {
+                list.push_back(b);
+                return;
+            }
+        }
+        delete b;
+    }
+
+    std::mutex mutex_;
+    std::array<std::vector<IoBuffer*>, CLASSES> free_;
+};
+
+class StreamImpl : public Stream, public std::enable_shared_from_this<StreamImpl> {
+ public:
+    StreamImpl(NabtoClientConnection* connection, NabtoClient* context, std::shared_ptr<BufferPool> pool)
+        : context_(context), pool_(pool)
     {
         stream_ = nabto_client_stream_new(connection);
     }
@@ -423,36 +1284,75 @@ class StreamImpl : public Stream {
     }
     std::shared_ptr<FutureVoid> open(uint32_t contentType)
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_stream_open(stream_, future->getFuture(), contentType);
         return future;
     }
     std::shared_ptr<FutureBuffer> readAll(size_t n)
     {
-        auto data = std::make_shared<std::vector<uint8_t> >(n);
-        auto transferred = std::make_shared<size_t>();
-        auto future = std::make_shared<FutureBufferImpl>(context_,data, transferred);
+        auto buffer = pool_->acquire(n);
+        auto data = BufferPool::data(buffer);
+        auto transferred = BufferPool::transferred(buffer);
+        auto future = makePooled<FutureBufferImpl>(context_,data, transferred);
         nabto_client_stream_read_all(stream_, future->getFuture(), data->data(), data->size(), transferred.get());
         return future;
     }
     std::shared_ptr<FutureBuffer> readSome(size_t max)
     {
-        auto data = std::make_shared<std::vector<uint8_t> >(max);
-        auto transferred = std::make_shared<size_t>();
-        auto future = std::make_shared<FutureBufferImpl>(context_, data, transferred);
+        auto buffer = pool_->acquire(max);
+        auto data = BufferPool::data(buffer);
+        auto transferred = BufferPool::transferred(buffer);
+        auto future = makePooled<FutureBufferImpl>(context_, data, transferred);
         nabto_client_stream_read_some(stream_, future->getFuture(), data->data(), data->size(), transferred.get());
         return future;
     }
+    std::shared_ptr<FutureSize> readAll(uint8_t* buffer, size_t n)
+    {
+        auto future = makePooled<FutureSizeImpl>(context_);
+        nabto_client_stream_read_all(stream_, future->getFuture(), buffer, n, future->getTransferred());
+        return future;
+    }
+    std::shared_ptr<FutureSize> readSome(uint8_t* buffer, size_t max)
+    {
+        auto future = makePooled<FutureSizeImpl>(context_);
+        nabto_client_stream_read_some(stream_, future->getFuture(), buffer, max, future->getTransferred());
+        return future;
+    }
     std::shared_ptr<FutureVoid> write(const std::vector<uint8_t>& buffer)
     {
-        auto data = std::make_shared<std::vector<uint8_t> >(buffer.begin(), buffer.end());
-        auto future = std::make_shared<FutureVoidImpl>(context_, data);
+        auto data = BufferPool::data(pool_->acquire(buffer.size()));
+        std::copy(buffer.begin(), buffer.end(), data->begin());
+        auto future = makePooled<FutureVoidImpl>(context_, data);
         nabto_client_stream_write(stream_, future->getFuture(), data->data(), data->size());
         return future;
     }
+    std::shared_ptr<FutureVoid> write(std::vector<uint8_t>&& buffer)
+    {
+        auto data = std::make_shared<std::vector<uint8_t> >(std::move(buffer));
+        auto future = makePooled<FutureVoidImpl>(context_, data);
+        nabto_client_stream_write(stream_, future->getFuture(), data->data(), data->size());
+        return future;
+    }
+    std::shared_ptr<FutureVoid> write(const uint8_t* buffer, size_t size)
+    {
+        auto future = makePooled<FutureVoidImpl>(context_);
+        nabto_client_stream_write(stream_, future->getFuture(), buffer, size);
+        return future;
+    }
+    std::shared_ptr<FutureVoid> writeVectored(std::vector<std::vector<uint8_t> > buffers)
+    {
+        // The SDK accepts one write at a time, the next buffer is
+        // written from the completion of the previous one.
+        auto write = std::make_shared<VectoredWrite>();
+        write->buffers_ = std::move(buffers);
+        write->stream_ = shared_from_this();
+        write->result_ = makePooled<FutureVoidPromiseImpl>(context_);
+        writeNext(write);
+        return write->result_;
+    }
     std::shared_ptr<FutureVoid> close()
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_stream_close(stream_, future->getFuture());
         return future;
     }
@@ -461,8 +1361,44 @@ class StreamImpl : public Stream {
         nabto_client_stream_abort(stream_);
     }
  private:
+    class VectoredWrite {
+     public:
+        std::vector<std::vector<uint8_t> > buffers_;
+        size_t next_ = 0;
+        std::weak_ptr<StreamImpl> stream_;
+        std::shared_ptr<FutureVoidPromiseImpl> result_;
+    };
+
+    static void writeNext(std::shared_ptr<VectoredWrite> write)
+    {
+        while (write->next_ < write->buffers_.size() && write->buffers_[write->next_].empty()) {
+            write->next_++;
+        }
+        if (write->next_ == write->buffers_.size()) {
+            write->result_->resolve(NABTO_CLIENT_EC_OK);
+            return;
+        }
+        auto self = write->stream_.lock();
+        if (!self) {
+            write->result_->resolve(NABTO_CLIENT_EC_STOPPED);
+            return;
+        }
+        const std::vector<uint8_t>& buffer = write->buffers_[write->next_++];
+        auto future = makePooled<FutureVoidImpl>(self->context_);
+        nabto_client_stream_write(self->stream_, future->getFuture(), buffer.data(), buffer.size());
+        // continue on the SDK thread, the result is posted to the executor of the caller.
+        future->onResult([write](Status status) {
+                if (!status.ok()) {
+                    write->result_->resolve(status.getErrorCode());
+                } else {
+                    writeNext(write);
+                }
+            }, inlineExecutor());
+    }
+
     NabtoClientStream* stream_;
     NabtoClient* context_;
+    std::shared_ptr<BufferPool> pool_;
 };
 
 class TcpTunnelImpl : public TcpTunnel {
@@ -477,14 +1413,14 @@ class TcpTunnelImpl : public TcpTunnel {
     };
     virtual std::shared_ptr<FutureVoid> open(const std::string& service, uint16_t localPort)
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_tcp_tunnel_open(tcpTunnel_, future->getFuture(), service.c_str(), localPort);
         return future;
     }
 
     virtual std::shared_ptr<FutureVoid> close()
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_tcp_tunnel_close(tcpTunnel_, future->getFuture());
         return future;
     }
@@ -549,8 +1485,8 @@ class ConnectionEventsListenerImpl : public std::enable_shared_from_this<Connect
 
 class ConnectionImpl : public Connection, public std::enable_shared_from_this<ConnectionImpl> {
  public:
-    ConnectionImpl(NabtoClient* context)
-        : context_(context)
+    ConnectionImpl(NabtoClient* context, std::shared_ptr<BufferPool> pool)
+        : context_(context), pool_(pool)
     {
         connection_ = nabto_client_connection_new(context);
     }
@@ -741,17 +1677,17 @@ class ConnectionImpl : public Connection, public std::enable_shared_from_this<Co
 
     std::shared_ptr<FutureVoid> connect()
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_connection_connect(connection_, future->getFuture());
         return future;
     }
     std::shared_ptr<Stream> createStream()
     {
-        return std::make_shared<StreamImpl>(connection_, context_);
+        return std::make_shared<StreamImpl>(connection_, context_, pool_);
     }
     std::shared_ptr<FutureVoid> close()
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_connection_close(connection_, future->getFuture());
         return future;
     }
@@ -768,35 +1704,73 @@ class ConnectionImpl : public Connection, public std::enable_shared_from_this<Co
 
     std::shared_ptr<FutureVoid> passwordAuthenticate(const std::string& username, const std::string& password)
     {
-        auto future = std::make_shared<FutureVoidImpl>(context_);
+        auto future = makePooled<FutureVoidImpl>(context_);
         nabto_client_connection_password_authenticate(connection_, username.c_str(), password.c_str(), future->getFuture());
         return future;
     }
 
+    typedef std::vector<std::shared_ptr<ConnectionEventsCallback> > EventsCallbacks;
+
     void notifyEvent(int event) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (auto cb : eventsCallbacks_) {
-            cb->onEvent(event);
+        // The callbacks run on a snapshot without holding any lock,
+        // such that a callback can add and remove listeners.
+        std::shared_ptr<const EventsCallbacks> callbacks = std::atomic_load(&eventsCallbacks_);
+        std::shared_ptr<Executor> executor = std::atomic_load(&eventsExecutor_);
+        if (!callbacks || callbacks->empty()) {
+            return;
+        }
+        if (!executor) {
+            executor = ContextResources::get(context_).executor_;
+        }
+        if (executor) {
+            executor->post([callbacks, event]() {
+                    for (auto cb : *callbacks) {
+                        cb->onEvent(event);
+                    }
+                });
+        } else {
+            for (auto cb : *callbacks) {
+                cb->onEvent(event);
+            }
         }
     }
 
     void addEventsListener(std::shared_ptr<ConnectionEventsCallback> callback)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        eventsCallbacks_.insert(callback);
-
+        auto current = std::atomic_load(&eventsCallbacks_);
+        auto next = current ? std::make_shared<EventsCallbacks>(*current) : std::make_shared<EventsCallbacks>();
+        if (std::find(next->begin(), next->end(), callback) == next->end()) {
+            next->push_back(callback);
+        }
+        std::atomic_store(&eventsCallbacks_, std::shared_ptr<const EventsCallbacks>(next));
     }
     void removeEventsListener(std::shared_ptr<ConnectionEventsCallback> callback)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        eventsCallbacks_.erase(callback);
+        auto current = std::atomic_load(&eventsCallbacks_);
+        if (!current) {
+            return;
+        }
+        auto next = std::make_shared<EventsCallbacks>(*current);
+        next->erase(std::remove(next->begin(), next->end(), callback), next->end());
+        std::atomic_store(&eventsCallbacks_, std::shared_ptr<const EventsCallbacks>(next));
+    }
+
+    void setEventsExecutor(std::shared_ptr<Executor> executor)
+    {
+        std::atomic_store(&eventsExecutor_, executor);
     }
 
  private:
     NabtoClientConnection* connection_;
     NabtoClient* context_;
+    // serializes the writers of eventsCallbacks_.
     std::mutex mutex_;
-    std::set<std::shared_ptr<ConnectionEventsCallback> > eventsCallbacks_;
+    // copy on write, always accessed with std::atomic_load/std::atomic_store.
+    std::shared_ptr<const EventsCallbacks> eventsCallbacks_;
+    std::shared_ptr<Executor> eventsExecutor_;
+    std::shared_ptr<BufferPool> pool_;
     std::shared_ptr<ConnectionEventsListenerImpl> connectionEventsListener_;
 };
 
@@ -838,17 +1812,28 @@ class LoggerProxy {
 
 class ContextImpl : public Context {
  public:
-    ContextImpl() {
+    ContextImpl()
+        : pool_(std::make_shared<BufferPool>())
+    {
         context_ = nabto_client_new();
+        handles_ = std::make_shared<FutureHandlePool>(context_);
+        ContextResources::setHandles(context_, handles_);
     }
     ~ContextImpl() {
         nabto_client_stop(context_);
         loggerProxy_.reset();
+        ContextResources::remove(context_);
+        // futures resolved by the stop have returned their handles by now.
+        handles_->close();
         nabto_client_free(context_);
     }
 
+    void setExecutor(std::shared_ptr<Executor> executor) {
+        ContextResources::setExecutor(context_, executor);
+    }
+
     std::shared_ptr<Connection> createConnection() {
-        auto ptr = std::make_shared<ConnectionImpl>(context_);
+        auto ptr = std::make_shared<ConnectionImpl>(context_, pool_);
         ptr->init();
         return ptr;
     }
@@ -889,6 +1874,10 @@ class ContextImpl : public Context {
  private:
     NabtoClient* context_;
     std::shared_ptr<LoggerProxy> loggerProxy_;
+    // stream I/O buffers shared by all streams of the context.
+    std::shared_ptr<BufferPool> pool_;
+    // recycled SDK future handles of the context.
+    std::shared_ptr<FutureHandlePool> handles_;
 
 };
 
@@ -903,7 +1892,187 @@ std::shared_ptr<Context> Context::create()
 
 void Future::callback(std::function<void (Status status)> cb)
 {
-    callback(std::make_shared<CallbackFunction>(cb));
+    onResult(std::move(cb), nullptr);
+}
+
+void Future::callback(std::shared_ptr<FutureCallback> cb, std::shared_ptr<Executor> executor)
+{
+    onResult([cb](Status status){ cb->run(status); }, executor);
+}
+
+void Future::callback(std::function<void (Status status)> cb, std::shared_ptr<Executor> executor)
+{
+    onResult(std::move(cb), executor);
+}
+
+std::shared_ptr<FutureVoid> Future::then(std::function<std::shared_ptr<Future> (Status status)> next)
+{
+    auto result = makePooled<FutureVoidPromiseImpl>(nullptr);
+    // next is application code, it runs on the executor of the context.
+    onResult([result, next](Status status) {
+            std::shared_ptr<Future> following;
+            try {
+                following = next(status);
+            } catch (NabtoException& e) {
+                result->resolve(e.status().getErrorCode());
+                return;
+            } catch (std::exception&) {
+                // an exception escaping into the SDK thread would end the process.
+                result->resolve(NABTO_CLIENT_EC_UNKNOWN);
+                return;
+            }
+            if (!following) {
+                result->resolve(status.getErrorCode());
+                return;
+            }
+            following->onResult([result](Status s) { result->resolve(s.getErrorCode()); }, inlineExecutor());
+        }, nullptr);
+    return result;
+}
+
+std::shared_ptr<FutureVoid> Future::whenAll(std::vector<std::shared_ptr<Future> > futures)
+{
+    class State {
+     public:
+        std::mutex mutex_;
+        size_t pending_;
+        NabtoClientError ec_ = NABTO_CLIENT_EC_OK;
+        std::shared_ptr<FutureVoidPromiseImpl> result_;
+    };
+    auto state = std::make_shared<State>();
+    state->pending_ = futures.size();
+    state->result_ = makePooled<FutureVoidPromiseImpl>(nullptr);
+    auto result = state->result_;
+    if (futures.empty()) {
+        result->resolve(NABTO_CLIENT_EC_OK);
+        return result;
+    }
+    for (auto& f : futures) {
+        f->onResult([state](Status status) {
+                NabtoClientError ec;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex_);
+                    if (!status.ok() && state->ec_ == NABTO_CLIENT_EC_OK) {
+                        state->ec_ = status.getErrorCode();
+                    }
+                    if (--state->pending_ > 0) {
+                        return;
+                    }
+                    ec = state->ec_;
+                }
+                state->result_->resolve(ec);
+            }, inlineExecutor());
+    }
+    return result;
+}
+
+std::shared_ptr<FutureSize> Future::whenAny(std::vector<std::shared_ptr<Future> > futures, std::vector<Canceller> cancellers)
+{
+    class State {
+     public:
+        std::mutex mutex_;
+        size_t pending_;
+        bool decided_ = false;
+        NabtoClientError lastError_ = NABTO_CLIENT_EC_OK;
+        std::vector<bool> resolved_;
+        std::vector<Canceller> cancellers_;
+        std::shared_ptr<FutureSizePromiseImpl> result_;
+    };
+    auto state = std::make_shared<State>();
+    state->pending_ = futures.size();
+    state->resolved_.resize(futures.size(), false);
+    state->cancellers_ = std::move(cancellers);
+    state->cancellers_.resize(futures.size());
+    state->result_ = makePooled<FutureSizePromiseImpl>(nullptr);
+    auto result = state->result_;
+    if (futures.empty()) {
+        result->resolve(NABTO_CLIENT_EC_INVALID_ARGUMENT, 0);
+        return result;
+    }
+    for (size_t i = 0; i < futures.size(); i++) {
+        futures[i]->onResult([state, i](Status status) {
+                std::vector<Canceller> losers;
+                bool won = false;
+                bool allFailed = false;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex_);
+                    state->resolved_[i] = true;
+                    state->pending_--;
+                    if (state->decided_) {
+                        return;
+                    }
+                    if (status.ok()) {
+                        state->decided_ = won = true;
+                        for (size_t j = 0; j < state->cancellers_.size(); j++) {
+                            if (!state->resolved_[j] && state->cancellers_[j]) {
+                                losers.push_back(state->cancellers_[j]);
+                            }
+                        }
+                    } else {
+                        state->lastError_ = status.getErrorCode();
+                        if (state->pending_ == 0) {
+                            state->decided_ = allFailed = true;
+                        }
+                    }
+                }
+                if (won) {
+                    state->result_->resolve(NABTO_CLIENT_EC_OK, i);
+                    for (auto& cancel : losers) {
+                        cancel();
+                    }
+                } else if (allFailed) {
+                    state->result_->resolve(state->lastError_, 0);
+                }
+            }, inlineExecutor());
+    }
+    return result;
+}
+
+std::shared_ptr<FutureVoid> Future::timer(int milliseconds)
+{
+    auto result = makePooled<FutureVoidPromiseImpl>(nullptr);
+    TimerQueue::instance().schedule(std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds), [result]() {
+            result->resolve(NABTO_CLIENT_EC_OK);
+        });
+    return result;
+}
+
+std::shared_ptr<FutureVoid> Future::withTimeout(std::shared_ptr<Future> future, int milliseconds, Canceller cancel)
+{
+    auto result = makePooled<FutureVoidPromiseImpl>(nullptr);
+    future->onResult([result](Status status) { result->resolve(status.getErrorCode()); }, inlineExecutor());
+    // the future holds the result until it resolves, so the timer does not need to.
+    std::weak_ptr<FutureVoidPromiseImpl> weak = result;
+    TimerQueue::instance().schedule(std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds), [weak, cancel]() {
+            auto r = weak.lock();
+            if (r && r->resolve(NABTO_CLIENT_EC_TIMEOUT) && cancel) {
+                cancel();
+            }
+        });
+    return result;
+}
+
+class PromiseVoidImpl : public PromiseVoid {
+ public:
+    PromiseVoidImpl()
+        : future_(makePooled<FutureVoidPromiseImpl>(nullptr))
+    {
+    }
+    std::shared_ptr<FutureVoid> getFuture()
+    {
+        return future_;
+    }
+    bool resolve(Status status)
+    {
+        return future_->resolve(status.getErrorCode());
+    }
+ private:
+    std::shared_ptr<FutureVoidPromiseImpl> future_;
+};
+
+std::shared_ptr<PromiseVoid> PromiseVoid::create()
+{
+    return makePooled<PromiseVoidImpl>();
 }
 
 } } // namespace
@@ -0,0 +1,104 @@
+#include "cbor_decoder.hpp"
+
+bool CborDecoder::parse(nabto::client::BufferView cbor)
+{
+    path_.clear();
+    return nlohmann::json::sax_parse(cbor.begin(), cbor.end(), this, nlohmann::json::input_format_t::cbor);
+}
+
+bool CborDecoder::null()
+{
+    return true;
+}
+
+bool CborDecoder::boolean(bool val)
+{
+    onBool(val);
+    return true;
+}
+
+bool CborDecoder::number_integer(nlohmann::json::number_integer_t)
+{
+    // negative numbers, none of the decoded fields can be negative.
+    return true;
+}
+
+bool CborDecoder::number_unsigned(nlohmann::json::number_unsigned_t val)
+{
+    onUnsigned(val);
+    return true;
+}
+
+bool CborDecoder::number_float(nlohmann::json::number_float_t, const std::string&)
+{
+    return true;
+}
+
+bool CborDecoder::string(std::string& val)
+{
+    onString(val);
+    return true;
+}
+
+bool CborDecoder::binary(nlohmann::json::binary_t&)
+{
+    return true;
+}
+
+bool CborDecoder::start_object(std::size_t)
+{
+    onStartMap();
+    path_.push_back(Level());
+    return true;
+}
+
+bool CborDecoder::key(std::string& val)
+{
+    path_.back().key_ = val;
+    return true;
+}
+
+bool CborDecoder::end_object()
+{
+    path_.pop_back();
+    onEndMap();
+    return true;
+}
+
+bool CborDecoder::start_array(std::size_t)
+{
+    onStartArray();
+    path_.push_back(Level());
+    path_.back().array_ = true;
+    return true;
+}
+
+bool CborDecoder::end_array()
+{
+    path_.pop_back();
+    return true;
+}
+
+bool CborDecoder::parse_error(std::size_t, const std::string&, const nlohmann::json::exception&)
+{
+    return false;
+}
+
+bool CborDecoder::at(std::initializer_list<const char*> path) const
+{
+    if (path.size() != path_.size()) {
+        return false;
+    }
+    size_t i = 0;
+    for (const char* k : path) {
+        const Level& level = path_[i++];
+        if (k == nullptr) {
+            if (!level.array_) {
+                return false;
+            }
+        } else if (level.array_ || level.key_ != k) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <nabto_client.hpp>
+#include <3rdparty/nlohmann/json.hpp>
+
+#include <cstdint>
+#include <initializer_list>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Decodes CBOR straight into typed structs through the nlohmann SAX
+ * interface, without building a json DOM and without exceptions. The
+ * decoder keeps the path of map keys and arrays from the root to the
+ * current item, subclasses match the path in the item callbacks
+ * and ignore the items they do not know. An item of an unexpected type
+ * is skipped like an unknown item, such that responses from devices
+ * with a newer or older schema still decode.
+ *
+ * A decoder for a type T has a Result typedef and a
+ * bool decode(nabto::client::BufferView cbor, T& out) function, which
+ * is what the coap endpoints expect.
+ */
+class CborDecoder {
+ public:
+    virtual ~CborDecoder() {}
+
+    // The nlohmann SAX interface.
+    bool null();
+    bool boolean(bool val);
+    bool number_integer(nlohmann::json::number_integer_t val);
+    bool number_unsigned(nlohmann::json::number_unsigned_t val);
+    bool number_float(nlohmann::json::number_float_t val, const std::string& s);
+    bool string(std::string& val);
+    bool binary(nlohmann::json::binary_t& val);
+    bool start_object(std::size_t elements);
+    bool key(std::string& val);
+    bool end_object();
+    bool start_array(std::size_t elements);
+    bool end_array();
+    bool parse_error(std::size_t position, const std::string& lastToken, const nlohmann::json::exception& ex);
+
+ protected:
+    // Returns false if the buffer is not well formed CBOR.
+    bool parse(nabto::client::BufferView cbor);
+
+    virtual void onString(std::string&) {}
+    virtual void onBool(bool) {}
+    virtual void onUnsigned(uint64_t) {}
+    // Called with the path of the map or array itself, before its first and after its last item.
+    virtual void onStartMap() {}
+    virtual void onEndMap() {}
+    virtual void onStartArray() {}
+
+    // True if the current item is at the path of map keys, a nullptr matches any item of an array.
+    bool at(std::initializer_list<const char*> path) const;
+
+ private:
+    class Level {
+     public:
+        bool array_ = false;
+        std::string key_;
+    };
+
+    std::vector<Level> path_;
+};
+
+/**
+ * Decodes an array of strings, e.g. the usernames from /iam/users.
+ */
+class CborStringSetDecoder : public CborDecoder {
+ public:
+    typedef std::set<std::string> Result;
+    bool decode(nabto::client::BufferView cbor, std::set<std::string>& strings)
+    {
+        strings_ = &strings;
+        return parse(cbor);
+    }
+ protected:
+    void onString(std::string& value)
+    {
+        if (at({nullptr})) {
+            strings_->insert(value);
+        }
+    }
+ private:
+    std::set<std::string>* strings_ = nullptr;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "cbor_decoder.hpp"
+#include "iam.hpp"
+
+#include <nabto_client.hpp>
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Typed coap endpoints. An endpoint is described by a class with the
+ * method and path template as constexpr functions, and the expected
+ * status code, content format, request type and response decoder as
+ * CoapEndpointTraits. CoapEndpoint<Endpoint> then builds the request,
+ * checks the response and decodes it without a json DOM, with retries
+ * of idempotent requests. Requests are asynchronous, the result is
+ * passed to a handler.
+ *
+ *   class GetUser : public CoapEndpointTraits<205, COAP_ANY_CONTENT_FORMAT, true, CoapNoPayload, UserDecoder> {
+ *    public:
+ *       static constexpr const char* method() { return "GET"; }
+ *       static constexpr const char* path() { return "/iam/users/{}"; }
+ *   };
+ *   CoapEndpoint<GetUser>::callAsync(connection, CoapNoPayload(), [](CoapResult<User>& result) {
+ *           ...
+ *       }, username);
+ */
+
+// The content format of the response is not checked.
+const static int COAP_ANY_CONTENT_FORMAT = -1;
+
+class CoapNoPayload {
+};
+
+// The result of an endpoint without a response payload.
+class CoapNoResult {
+};
+
+class CoapNoResponseDecoder {
+ public:
+    typedef CoapNoResult Result;
+    bool decode(nabto::client::BufferView, CoapNoResult&) { return true; }
+};
+
+template<int Status, int ContentFormat, bool Idempotent, typename Request, typename Decoder>
+class CoapEndpointTraits {
+ public:
+    enum {
+        STATUS = Status,
+        CONTENT_FORMAT = ContentFormat,
+        IDEMPOTENT = Idempotent
+    };
+    typedef Request RequestType;
+    typedef Decoder DecoderType;
+};
+
+/**
+ * Minimal CBOR encoding of the request payloads, found by overload
+ * resolution and argument dependent lookup from CoapEndpoint.
+ */
+inline void cborHead(std::vector<uint8_t>& out, uint8_t majorType, uint64_t value)
+{
+    uint8_t major = majorType << 5;
+    if (value < 24) {
+        out.push_back(major | static_cast<uint8_t>(value));
+    } else if (value <= 0xff) {
+        out.push_back(major | 24);
+        out.push_back(static_cast<uint8_t>(value));
+    } else if (value <= 0xffff) {
+        out.push_back(major | 25);
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    } else {
+        out.push_back(major | 26);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+}
+
+inline void encodeCbor(std::vector<uint8_t>& out, const std::string& value)
+{
+    cborHead(out, 3, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+inline void encodeCbor(std::vector<uint8_t>& out, bool value)
+{
+    out.push_back(value ? 0xf5 : 0xf4);
+}
+
+// The number of {} placeholders in a path template.
+constexpr size_t coapPathPlaceholders(const char* path)
+{
+    size_t n = 0;
+    for (; *path; path++) {
+        if (path[0] == '{' && path[1] == '}') {
+            n++;
+        }
+    }
+    return n;
+}
+
+// Formats a path template into a string of the exact size, such that it allocates once.
+template<typename... Args>
+std::string coapFormatPath(const char* path, const Args&... args)
+{
+    const std::string* parts[] = { &args..., nullptr };
+    size_t length = strlen(path) - 2 * sizeof...(Args);
+    for (size_t i = 0; i < sizeof...(Args); i++) {
+        length += parts[i]->size();
+    }
+    std::string formatted;
+    formatted.reserve(length);
+    size_t next = 0;
+    for (const char* p = path; *p; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            formatted += *parts[next++];
+            p++;
+        } else {
+            formatted += *p;
+        }
+    }
+    return formatted;
+}
+
+template<typename T>
+class CoapResult {
+ public:
+    bool ok() const { return value_ != nullptr; }
+    // The request once a response has arrived, e.g. for the status code of an unexpected response.
+    std::shared_ptr<nabto::client::Coap> coap_;
+    // Set if the request failed in the SDK.
+    std::shared_ptr<nabto::client::NabtoException> exception_;
+    // Set if the response had the expected status but could not be decoded.
+    std::string decodeError_;
+    std::unique_ptr<T> value_;
+};
+
+template<typename Endpoint>
+class CoapEndpoint {
+ public:
+    typedef typename Endpoint::RequestType Request;
+    typedef typename Endpoint::DecoderType Decoder;
+    typedef typename Decoder::Result Result;
+    typedef std::function<void (CoapResult<Result>& result)> Handler;
+
+    // Retries of an idempotent request which timed out.
+    static const int maxRetries = 1;
+
+    /**
+     * The handler is called on the SDK thread, or on the executor of
+     * the context, when the request and its retries are done.
+     */
+    template<typename... PathArgs>
+    static void callAsync(std::shared_ptr<nabto::client::Connection> connection, const Request& request, Handler handler, const PathArgs&... pathArgs)
+    {
+        static_assert(coapPathPlaceholders(Endpoint::path()) == sizeof...(PathArgs), "the number of path arguments does not match the path template");
+        auto state = std::make_shared<AsyncCall>();
+        state->connection_ = connection;
+        state->path_ = coapFormatPath(Endpoint::path(), pathArgs...);
+        state->request_ = request;
+        state->handler_ = std::move(handler);
+        attempt(state);
+    }
+
+ private:
+    class AsyncCall {
+     public:
+        std::shared_ptr<nabto::client::Connection> connection_;
+        std::string path_;
+        Request request_;
+        Handler handler_;
+        int attempt_ = 0;
+    };
+
+    static std::shared_ptr<nabto::client::Coap> build(std::shared_ptr<nabto::client::Connection> connection, const std::string& path, const Request& request)
+    {
+        auto coap = connection->createCoap(Endpoint::method(), path);
+        if (!coap) {
+            throw nabto::client::NabtoException(nabto::client::Status::INVALID_ARGUMENT);
+        }
+        setPayload(*coap, request);
+        return coap;
+    }
+
+    static void setPayload(nabto::client::Coap&, const CoapNoPayload&)
+    {
+    }
+
+    template<typename T>
+    static void setPayload(nabto::client::Coap& coap, const T& request)
+    {
+        std::vector<uint8_t> cbor;
+        encodeCbor(cbor, request);
+        coap.setRequestPayload(IAM::CONTENT_FORMAT_APPLICATION_CBOR, cbor);
+    }
+
+    static CoapResult<Result> complete(std::shared_ptr<nabto::client::Coap> coap)
+    {
+        CoapResult<Result> result;
+        result.coap_ = coap;
+        if (coap->getResponseStatusCode() != Endpoint::STATUS) {
+            return result;
+        }
+        if (Endpoint::CONTENT_FORMAT != COAP_ANY_CONTENT_FORMAT && coap->getResponseContentFormat() != Endpoint::CONTENT_FORMAT) {
+            result.decodeError_ = std::string("Unexpected content format of the response from ") + Endpoint::path();
+            return result;
+        }
+        auto value = std::make_unique<Result>();
+        if (!Decoder().decode(coap->getResponsePayloadView(), *value)) {
+            result.decodeError_ = std::string("Could not decode the response from ") + Endpoint::path();
+            return result;
+        }
+        result.value_ = std::move(value);
+        return result;
+    }
+
+    static bool retry(nabto::client::NabtoException& e, int attempt)
+    {
+        return Endpoint::IDEMPOTENT && attempt < maxRetries && e.status().getErrorCode() == nabto::client::Status::TIMEOUT;
+    }
+
+    static void attempt(std::shared_ptr<AsyncCall> state)
+    {
+        std::shared_ptr<nabto::client::Coap> coap;
+        std::shared_ptr<nabto::client::FutureVoid> future;
+        try {
+            coap = build(state->connection_, state->path_, state->request_);
+            future = coap->execute();
+        } catch (nabto::client::NabtoException& e) {
+            failed(state, e);
+            return;
+        }
+        // the future is not captured, it would keep itself alive through its own callback.
+        future->onResult([state, coap](nabto::client::Status status) {
+                if (!status.ok()) {
+                    failed(state, nabto::client::NabtoException(status));
+                    return;
+                }
+                CoapResult<Result> result;
+                try {
+                    result = complete(coap);
+                } catch (nabto::client::NabtoException& e) {
+                    result.exception_ = std::make_shared<nabto::client::NabtoException>(e);
+                }
+                state->handler_(result);
+            }, nullptr);
+    }
+
+    static void failed(std::shared_ptr<AsyncCall> state, nabto::client::NabtoException e)
+    {
+        if (retry(e, state->attempt_++)) {
+            attempt(state);
+            return;
+        }
+        CoapResult<Result> result;
+        result.exception_ = std::make_shared<nabto::client::NabtoException>(e);
+        state->handler_(result);
+    }
+};
+
+template<typename Endpoint>
+const int CoapEndpoint<Endpoint>::maxRetries;
@@ -11,6 +11,11 @@
 #include <algorithm>
 #include <memory>
 #include <list>
+#include <mutex>
+#include <unordered_set>
+#include <cstring>
+#include <stdexcept>
+#include <iterator>
 
 #if defined(_WIN32)
 #include <direct.h>
@@ -30,36 +35,329 @@ static struct
     string ConfigFilePath;
     string StateFilePath;
     string KeyFilePath;
-    std::map<int, DeviceInfo> Bookmarks;
+    // Current snapshot, always accessed with std::atomic_load/std::atomic_store.
+    std::shared_ptr<const BookmarkIndex> Bookmarks;
+    // Serializes writers which replace the Bookmarks snapshot.
+    std::mutex BookmarksMutex;
 
     bool HasLoadedConfigFile;
     string ServerUrl;
 } Configuration;
 
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool Fingerprint::fromHex(const std::string& hex, Fingerprint& out)
+{
+    if (hex.size() % 2 != 0 || hex.size() / 2 > MAX_SIZE) {
+        return false;
+    }
+    uint8_t bytes[MAX_SIZE] = {};
+    for (size_t i = 0; i < hex.size() / 2; i++) {
+        int high = HexValue(hex[2*i]);
+        int low = HexValue(hex[2*i+1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = (uint8_t)((high << 4) | low);
+    }
+    std::memcpy(out.words_.data(), bytes, MAX_SIZE);
+    out.size_ = (uint8_t)(hex.size() / 2);
+    return true;
+}
+
+std::string Fingerprint::toHex() const
+{
+    static const char* digits = "0123456789abcdef";
+    uint8_t bytes[MAX_SIZE];
+    std::memcpy(bytes, words_.data(), MAX_SIZE);
+    std::string hex;
+    hex.reserve(size_ * 2);
+    for (size_t i = 0; i < size_; i++) {
+        hex.push_back(digits[bytes[i] >> 4]);
+        hex.push_back(digits[bytes[i] & 0x0f]);
+    }
+    return hex;
+}
+
+// std::unordered_set never moves its nodes so the pointers stay
+// valid for the lifetime of the process.
+static std::mutex InternMutex;
+static std::unordered_set<std::string> InternPool;
+
+static const std::string* Intern(const std::string& str)
+{
+    std::lock_guard<std::mutex> lock(InternMutex);
+    return &(*InternPool.insert(str).first);
+}
+
+bool InternedString::find(const std::string& str, InternedString& out)
+{
+    std::lock_guard<std::mutex> lock(InternMutex);
+    auto it = InternPool.find(str);
+    if (it == InternPool.end()) {
+        return false;
+    }
+    out.str_ = &(*it);
+    return true;
+}
+
+InternedString::InternedString() : str_(Intern(""))
+{
+}
+
+InternedString::InternedString(const std::string& str) : str_(Intern(str))
+{
+}
+
 void to_json(json& j, const DeviceInfo& d)
 {
     j = json({
-            {"DeviceFingerprint", d.deviceFingerprint_},
-            {"DeviceId", d.deviceId_},
-            {"ProductId", d.productId_},
+            {"DeviceFingerprint", d.deviceFingerprint_.toHex()},
+            {"DeviceId", d.deviceId_.str()},
+            {"ProductId", d.productId_.str()},
             {"Sct", d.sct_}
         });
-    if (!d.directCandidate_.empty()) {
-        j["DirectCandidate"] = d.directCandidate_;
+    if (!d.directCandidates_.empty()) {
+        json Candidates = json::array();
+        for (auto& c : d.directCandidates_) {
+            Candidates.push_back({
+                    {"Host", c.host_},
+                    {"Port", c.port_},
+                    {"RttMs", c.rttMs_},
+                    {"Successes", c.successes_},
+                    {"Failures", c.failures_}
+                });
+        }
+        j["DirectCandidates"] = Candidates;
+    }
+    if (!d.tags_.empty()) {
+        json Tags = json::array();
+        for (auto& t : d.tags_) {
+            Tags.push_back(t.str());
+        }
+        j["Tags"] = Tags;
+    }
+    const DeviceAttributes& a = d.attributes_;
+    if (!a.friendlyName_.empty() || !a.appName_.empty() || !a.services_.empty()) {
+        json Services = json::array();
+        for (auto& s : a.services_) {
+            Services.push_back(s.str());
+        }
+        j["Attributes"] = json({
+                {"FriendlyName", a.friendlyName_},
+                {"AppName", a.appName_},
+                {"Services", Services}
+            });
     }
 }
 
 void from_json(const json& j, DeviceInfo& d)
 {
-    j.at("DeviceFingerprint").get_to(d.deviceFingerprint_);
-    j.at("DeviceId").get_to(d.deviceId_);
-    j.at("ProductId").get_to(d.productId_);
+    if (!Fingerprint::fromHex(j.at("DeviceFingerprint").get<std::string>(), d.deviceFingerprint_)) {
+        throw std::invalid_argument("invalid DeviceFingerprint");
+    }
+    d.deviceId_ = InternedString(j.at("DeviceId").get<std::string>());
+    d.productId_ = InternedString(j.at("ProductId").get<std::string>());
     j.at("Sct").get_to(d.sct_);
     try {
-        j.at("DirectCandidate").get_to(d.directCandidate_);
+        // single host written by older versions.
+        DirectCandidate c;
+        c.host_ = j.at("DirectCandidate").get<std::string>();
+        d.directCandidates_.push_back(c);
     } catch (const std::exception& e) {
         // no direct candidate, fine
     }
+    if (j.contains("DirectCandidates")) {
+        for (auto& jc : j["DirectCandidates"]) {
+            DirectCandidate c;
+            jc.at("Host").get_to(c.host_);
+            try {
+                jc.at("Port").get_to(c.port_);
+                jc.at("RttMs").get_to(c.rttMs_);
+                jc.at("Successes").get_to(c.successes_);
+                jc.at("Failures").get_to(c.failures_);
+            } catch (const std::exception& e) { }
+            d.directCandidates_.push_back(c);
+        }
+    }
+    if (j.contains("Tags")) {
+        for (auto& t : j["Tags"]) {
+            d.tags_.push_back(InternedString(t.get<std::string>()));
+        }
+    }
+    if (j.contains("Attributes")) {
+        const json& a = j["Attributes"];
+        try {
+            a.at("FriendlyName").get_to(d.attributes_.friendlyName_);
+        } catch (const std::exception& e) { }
+        try {
+            a.at("AppName").get_to(d.attributes_.appName_);
+        } catch (const std::exception& e) { }
+        if (a.contains("Services")) {
+            for (auto& s : a["Services"]) {
+                d.attributes_.services_.push_back(InternedString(s.get<std::string>()));
+            }
+        }
+    }
+}
+
+bool DirectCandidate::parse(const std::string& in, DirectCandidate& out, uint16_t defaultPort)
+{
+    std::string host = in;
+    std::string port;
+    if (!in.empty() && in[0] == '[') {
+        size_t end = in.find(']');
+        if (end == std::string::npos) {
+            return false;
+        }
+        host = in.substr(1, end - 1);
+        if (end + 1 < in.size()) {
+            if (in[end + 1] != ':') {
+                return false;
+            }
+            port = in.substr(end + 2);
+        }
+    } else if (std::count(in.begin(), in.end(), ':') == 1) {
+        // exactly one colon is host:port, more colons is a bare ipv6 address.
+        size_t colon = in.find(':');
+        host = in.substr(0, colon);
+        port = in.substr(colon + 1);
+    }
+    if (host.empty()) {
+        return false;
+    }
+    out = DirectCandidate();
+    out.host_ = host;
+    out.port_ = defaultPort;
+    if (!port.empty()) {
+        try {
+            int p = std::stoi(port);
+            if (p <= 0 || p > 65535) {
+                return false;
+            }
+            out.port_ = (uint16_t)p;
+        } catch (const std::exception& e) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DirectCandidate::toString() const
+{
+    std::stringstream ss;
+    if (host_.find(':') != std::string::npos) {
+        ss << "[" << host_ << "]:" << port_;
+    } else {
+        ss << host_ << ":" << port_;
+    }
+    return ss.str();
+}
+
+BookmarkIndex::BookmarkIndex(std::shared_ptr<const BookmarkMap> bookmarks)
+    : bookmarks_(bookmarks)
+{
+    // the map is ordered by index so every posting list is built sorted.
+    for (auto& b : *bookmarks_) {
+        for (auto& t : b.second->getTags()) {
+            tags_[t].push_back(b.first);
+        }
+        for (auto& s : b.second->getAttributes().getServices()) {
+            services_[s].push_back(b.first);
+        }
+        devices_[std::make_pair(b.second->productId_, b.second->deviceId_)] = b.first;
+        deviceIds_[b.second->deviceId_].push_back(b.first);
+    }
+}
+
+bool BookmarkIndex::intersect(const PostingLists& lists, const std::vector<std::string>& keys, std::vector<int>& result, bool& first)
+{
+    for (auto& k : keys) {
+        InternedString key;
+        if (!InternedString::find(k, key)) {
+            return false;
+        }
+        auto it = lists.find(key);
+        if (it == lists.end()) {
+            return false;
+        }
+        if (first) {
+            result = it->second;
+            first = false;
+        } else {
+            std::vector<int> tmp;
+            std::set_intersection(result.begin(), result.end(), it->second.begin(), it->second.end(), std::back_inserter(tmp));
+            result.swap(tmp);
+        }
+        if (result.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::shared_ptr<const DeviceInfo> > BookmarkIndex::query(const std::vector<std::string>& tags, const std::vector<std::string>& services) const
+{
+    std::vector<std::shared_ptr<const DeviceInfo> > devices;
+    if (tags.empty() && services.empty()) {
+        for (auto& b : *bookmarks_) {
+            devices.push_back(b.second);
+        }
+        return devices;
+    }
+
+    std::vector<int> indexes;
+    bool first = true;
+    if (!intersect(tags_, tags, indexes, first) ||
+        !intersect(services_, services, indexes, first)) {
+        return devices;
+    }
+    for (auto i : indexes) {
+        devices.push_back(bookmarks_->at(i));
+    }
+    return devices;
+}
+
+std::shared_ptr<const DeviceInfo> BookmarkIndex::find(const std::string& productId, const std::string& deviceId) const
+{
+    InternedString product;
+    InternedString device;
+    if (!InternedString::find(productId, product) || !InternedString::find(deviceId, device)) {
+        return nullptr;
+    }
+    auto it = devices_.find(std::make_pair(product, device));
+    if (it == devices_.end()) {
+        return nullptr;
+    }
+    return bookmarks_->at(it->second);
+}
+
+std::shared_ptr<const DeviceInfo> BookmarkIndex::findByDeviceId(const std::string& deviceId) const
+{
+    InternedString key;
+    if (!InternedString::find(deviceId, key)) {
+        return nullptr;
+    }
+    auto it = deviceIds_.find(key);
+    if (it == deviceIds_.end() || it->second.size() != 1) {
+        return nullptr;
+    }
+    return bookmarks_->at(it->second.front());
+}
+
+static void PublishBookmarks(std::shared_ptr<const BookmarkMap> Bookmarks)
+{
+    std::atomic_store(&Configuration.Bookmarks, std::shared_ptr<const BookmarkIndex>(std::make_shared<BookmarkIndex>(Bookmarks)));
 }
 
 bool WriteStringToFile(const string& String, const string& Filename)
@@ -141,12 +439,14 @@ void CommonInit()
         // NOTE(as): State file wasn't found, it'll probably be created later.
     }
 
+    auto Bookmarks = std::make_shared<BookmarkMap>();
     try
     {
         for(auto Device : StateContents["devices"])
         {
-            DeviceInfo Info = Device.get<DeviceInfo>();
-            Configuration.Bookmarks[Configuration.Bookmarks.size()] = Info;
+            auto Info = std::make_shared<DeviceInfo>(Device.get<DeviceInfo>());
+            Info->index_ = (int)Bookmarks->size();
+            (*Bookmarks)[Info->index_] = Info;
         }
     }
     catch (...)
@@ -155,8 +455,9 @@ void CommonInit()
         // TODO(as): Analyze the file and let the user know where exactly it went wrong?
         std::cerr << "IMPORTANT: Your state file (" << Configuration.StateFilePath << ") seems to be incorrect.\n" <<
             "As a result no paired devices were loaded from it." << std::endl;
-        Configuration.Bookmarks.clear();
+        Bookmarks->clear();
     }
+    PublishBookmarks(Bookmarks);
 }
 
 string NormalizePath(const char *Path)
@@ -198,6 +499,54 @@ bool CreateClientConfigurationFile()
     return WriteStringToFile(clientConfig, Configuration.ConfigFilePath);
 }
 
+static const std::vector<std::string> IntegerConnectionOptions = { "KeepAliveInterval", "KeepAliveRetryInterval", "KeepAliveMaxRetries", "DtlsHelloTimeout" };
+static const std::vector<std::string> BooleanConnectionOptions = { "Local", "Remote", "Rendezvous", "ScanLocalConnect" };
+
+/**
+ * Read a connection profile on top of Base such that a device profile
+ * only has to list the options where it differs from the default.
+ */
+static bool ParseConnectionProfile(const json& Profile, const ConnectionProfile& Base, ConnectionProfile& Out)
+{
+    if (!Profile.is_object()) {
+        return false;
+    }
+    json Options = json::parse(Base.options_);
+    Out = Base;
+    for (auto it = Profile.begin(); it != Profile.end(); it++) {
+        const std::string& Key = it.key();
+        if (Key == "DirectCandidatePort") {
+            if (!it->is_number_unsigned() || it->get<uint32_t>() == 0 || it->get<uint32_t>() > 65535) {
+                std::cerr << "DirectCandidatePort must be a port number" << std::endl;
+                return false;
+            }
+            Out.directCandidatePort_ = (uint16_t)it->get<uint32_t>();
+        } else if (std::find(IntegerConnectionOptions.begin(), IntegerConnectionOptions.end(), Key) != IntegerConnectionOptions.end()) {
+            if (!it->is_number_unsigned()) {
+                std::cerr << "The connection option " << Key << " must be a non negative integer" << std::endl;
+                return false;
+            }
+            Options[Key] = it->get<uint32_t>();
+        } else if (std::find(BooleanConnectionOptions.begin(), BooleanConnectionOptions.end(), Key) != BooleanConnectionOptions.end()) {
+            if (!it->is_boolean()) {
+                std::cerr << "The connection option " << Key << " must be true or false" << std::endl;
+                return false;
+            }
+            Options[Key] = it->get<bool>();
+        } else {
+            std::cerr << "Ignoring unknown connection option " << Key << std::endl;
+        }
+    }
+    if (Options.contains("Local")) {
+        Out.local_ = Options["Local"].get<bool>();
+    }
+    if (Options.contains("Remote")) {
+        Out.remote_ = Options["Remote"].get<bool>();
+    }
+    Out.options_ = Options.dump();
+    return true;
+}
+
 std::unique_ptr<ClientConfiguration> GetConfigInfo()
 {
     if (!FileExists(Configuration.ConfigFilePath)) {
@@ -222,7 +571,42 @@ std::unique_ptr<ClientConfiguration> GetConfigInfo()
         // fine the server url is optional.
     }
 
-    return std::make_unique<ClientConfiguration>(serverUrl);
+    bool hedgedConnect = false;
+    try {
+        hedgedConnect = Contents["HedgedConnect"].get<bool>();
+    } catch (std::exception& e) {
+        // optional, defaults to false.
+    }
+
+    // "ConnectionOptions": { "Default": { ... }, "Devices": { "<productId>.<deviceId>": { ... } } }
+    ConnectionProfile defaultProfile;
+    std::map<std::string, ConnectionProfile> deviceProfiles;
+    if (Contents.contains("ConnectionOptions")) {
+        const json& Options = Contents["ConnectionOptions"];
+        if (Options.contains("Default") && !ParseConnectionProfile(Options["Default"], ConnectionProfile(), defaultProfile)) {
+            std::cerr << "Invalid default connection options in " << Configuration.ConfigFilePath << std::endl;
+            return nullptr;
+        }
+        if (Options.contains("Devices") && Options["Devices"].is_object()) {
+            for (auto it = Options["Devices"].begin(); it != Options["Devices"].end(); it++) {
+                ConnectionProfile profile;
+                if (!ParseConnectionProfile(it.value(), defaultProfile, profile)) {
+                    std::cerr << "Invalid connection options for " << it.key() << " in " << Configuration.ConfigFilePath << std::endl;
+                    return nullptr;
+                }
+                deviceProfiles[it.key()] = profile;
+            }
+        }
+    }
+
+    int idleConnectionTimeout = ClientConfiguration::DEFAULT_IDLE_CONNECTION_TIMEOUT;
+    try {
+        idleConnectionTimeout = Contents["IdleConnectionTimeout"].get<int>();
+    } catch (std::exception& e) {
+        // optional
+    }
+
+    return std::make_unique<ClientConfiguration>(serverUrl, hedgedConnect, defaultProfile, deviceProfiles, idleConnectionTimeout);
 }
 
 const char* GetConfigFilePath()
@@ -235,38 +619,111 @@ const char* GetStateFilePath()
     return Configuration.StateFilePath.c_str();
 }
 
-bool WriteStateFile()
+static bool WriteStateFile(const BookmarkMap& Bookmarks)
 {
     json BookmarksArray = json::array();
-    for (auto Bookmark : Configuration.Bookmarks) {
-        BookmarksArray.push_back(Bookmark.second);
+    for (auto& Bookmark : Bookmarks) {
+        BookmarksArray.push_back(*Bookmark.second);
     }
     json Contents = { {"devices", BookmarksArray} };
 
     return WriteStringToFile(Contents.dump(2), Configuration.StateFilePath);
 }
 
-std::unique_ptr<DeviceInfo> GetPairedDevice(int index)
+bool WriteStateFile()
 {
-    if (index >= 0 && Configuration.Bookmarks.size() > static_cast<unsigned int>(index))
-    {
-        auto device = std::make_unique<DeviceInfo>(Configuration.Bookmarks[index]);
-        device->index_ = index;
-        return device;
+    return WriteStateFile(*GetBookmarks());
+}
+
+std::shared_ptr<const BookmarkIndex> GetBookmarkIndex()
+{
+    auto Index = std::atomic_load(&Configuration.Bookmarks);
+    if (!Index) {
+        return std::make_shared<const BookmarkIndex>(std::make_shared<const BookmarkMap>());
     }
-    else
-    {
+    return Index;
+}
+
+std::shared_ptr<const BookmarkMap> GetBookmarks()
+{
+    return GetBookmarkIndex()->getBookmarks();
+}
+
+// Replace a single bookmark with a modified copy, returns false if the
+// bookmark does not exist or the update function did not change it.
+template<typename F>
+static bool ModifyBookmark(int Index, F Update)
+{
+    std::lock_guard<std::mutex> lock(Configuration.BookmarksMutex);
+    auto Current = GetBookmarks();
+    auto it = Current->find(Index);
+    if (it == Current->end()) {
+        return false;
+    }
+    auto Device = std::make_shared<DeviceInfo>(*it->second);
+    if (!Update(*Device)) {
+        return false;
+    }
+    auto Bookmarks = std::make_shared<BookmarkMap>(*Current);
+    (*Bookmarks)[Index] = Device;
+    PublishBookmarks(Bookmarks);
+    return WriteStateFile(*Bookmarks);
+}
+
+bool SetBookmarkTag(int Index, const std::string& Tag, bool Present)
+{
+    InternedString T(Tag);
+    return ModifyBookmark(Index, [&T, Present](DeviceInfo& Device) {
+            auto it = std::find(Device.tags_.begin(), Device.tags_.end(), T);
+            if (Present && it == Device.tags_.end()) {
+                Device.tags_.push_back(T);
+                return true;
+            } else if (!Present && it != Device.tags_.end()) {
+                Device.tags_.erase(it);
+                return true;
+            }
+            return false;
+        });
+}
+
+bool UpdateBookmarkDirectCandidates(int Index, std::function<bool (std::vector<DirectCandidate>& Candidates)> Edit)
+{
+    return ModifyBookmark(Index, [&Edit](DeviceInfo& Device) {
+            return Edit(Device.directCandidates_);
+        });
+}
+
+bool UpdateBookmarkAttributes(int Index, const DeviceAttributes& Attributes)
+{
+    return ModifyBookmark(Index, [&Attributes](DeviceInfo& Device) {
+            if (Device.attributes_ == Attributes) {
+                return false;
+            }
+            Device.attributes_ = Attributes;
+            return true;
+        });
+}
+
+std::shared_ptr<const DeviceInfo> GetPairedDevice(int index)
+{
+    auto Bookmarks = GetBookmarks();
+    auto it = Bookmarks->find(index);
+    if (it == Bookmarks->end()) {
         return nullptr;
     }
+    return it->second;
 }
 
-std::unique_ptr<DeviceInfo> GetPairedDevice(const std::string& deviceFingerprint)
+std::shared_ptr<const DeviceInfo> GetPairedDevice(const std::string& deviceFingerprint)
 {
-    for (auto& bookmark : Configuration.Bookmarks) {
-        if (bookmark.second.getDeviceFingerprint() == deviceFingerprint ) {
-            auto device = std::make_unique<DeviceInfo>(bookmark.second);
-            device->index_ = bookmark.first;
-            return device;
+    Fingerprint fingerprint;
+    if (!Fingerprint::fromHex(deviceFingerprint, fingerprint)) {
+        return nullptr;
+    }
+    auto Bookmarks = GetBookmarks();
+    for (auto& bookmark : *Bookmarks) {
+        if (bookmark.second->getDeviceFingerprint() == fingerprint) {
+            return bookmark.second;
         }
     }
     return nullptr;
@@ -274,23 +731,30 @@ std::unique_ptr<DeviceInfo> GetPairedDevice(const std::string& deviceFingerprint
 
 bool HasNoBookmarks()
 {
-    return Configuration.Bookmarks.empty();
+    return GetBookmarks()->empty();
 }
 
 void AddPairedDeviceToBookmarks(DeviceInfo& Info)
 {
-    for (auto b : Configuration.Bookmarks) {
-        if (b.second.getDeviceId() == Info.getDeviceId() && b.second.getProductId() == Info.getProductId()) {
-            Configuration.Bookmarks[b.first] = Info;
+    std::lock_guard<std::mutex> lock(Configuration.BookmarksMutex);
+    auto Bookmarks = std::make_shared<BookmarkMap>(*GetBookmarks());
+
+    Info.index_ = Bookmarks->empty() ? 0 : Bookmarks->rbegin()->first + 1;
+    for (auto& b : *Bookmarks) {
+        if (b.second->deviceId_ == Info.deviceId_ && b.second->productId_ == Info.productId_) {
             Info.index_ = b.first;
-            return;
+            // a repairing keeps the user defined tags and the direct candidates of the bookmark.
+            if (Info.tags_.empty()) {
+                Info.tags_ = b.second->tags_;
+            }
+            if (Info.directCandidates_.empty()) {
+                Info.directCandidates_ = b.second->directCandidates_;
+            }
+            break;
         }
     }
-
-    size_t index = Configuration.Bookmarks.size();
-    Configuration.Bookmarks[index] = Info;
-    Info.index_ = index;
-    return;
+    (*Bookmarks)[Info.index_] = std::make_shared<const DeviceInfo>(Info);
+    PublishBookmarks(Bookmarks);
 }
 
 bool CreatePrivateKeyFile(std::shared_ptr<nabto::client::Context> Context)
@@ -310,32 +774,34 @@ bool GetPrivateKey(std::shared_ptr<nabto::client::Context> Context, string& Out)
     return ReadEntireFileZeroTerminated(Configuration.KeyFilePath, Out);
 }
 
-std::map<int, Configuration::DeviceInfo> PrintBookmarks()
-{   
-    int index = 0;
-    if (Configuration.Bookmarks.empty())
+std::shared_ptr<const BookmarkMap> PrintBookmarks()
+{
+    auto Bookmarks = GetBookmarks();
+    if (Bookmarks->empty())
     {
         std::cout << "No bookmarked devices were found. Maybe you should pair with a few devices?" << std::endl;
     }
     std::cout << "The following devices are saved in your bookmarks:" << std::endl;
-    for (auto Bookmark : Configuration.Bookmarks)
+    for (auto& Bookmark : *Bookmarks)
     {
-        std::cout << "[" << index << "] ProductId: " << Bookmark.second.getProductId() << " DeviceId: " << Bookmark.second.getDeviceId() << std::endl;
-        index++;
+        // the bookmark index, deleted bookmarks leave gaps.
+        std::cout << "[" << Bookmark.first << "] ProductId: " << Bookmark.second->getProductId() << " DeviceId: " << Bookmark.second->getDeviceId() << std::endl;
     }
-    return Configuration.Bookmarks;    
-
+    return Bookmarks;
 }
 
 
 bool DeleteBookmark(const uint32_t& bookmark)
 {
-    if (Configuration.Bookmarks.find(bookmark) == Configuration.Bookmarks.end()) {
+    std::lock_guard<std::mutex> lock(Configuration.BookmarksMutex);
+    auto Bookmarks = std::make_shared<BookmarkMap>(*GetBookmarks());
+    if (Bookmarks->find(bookmark) == Bookmarks->end()) {
         std::cerr << "The bookmark " << bookmark << " does not exist" << std::endl;
         return false;
     }
-    Configuration.Bookmarks.erase(bookmark);
-    return WriteStateFile();
+    Bookmarks->erase(bookmark);
+    PublishBookmarks(Bookmarks);
+    return WriteStateFile(*Bookmarks);
 }
 
 bool makeDirectory(const std::string& directory)
@@ -1,8 +1,12 @@
 #pragma once
 #include <string>
 #include <map>
+#include <array>
+#include <vector>
 
 #include <memory>
+#include <functional>
+#include <cstdint>
 
 #include <sstream>
 
@@ -31,6 +35,111 @@ const std::string StateFileName = "state/tcp_tunnel_client_state.json";
 const std::string KeyFileName = "keys/client.key";
 
 
+/**
+ * A device fingerprint kept as its raw bytes instead of the 64
+ * character hex string. The bytes are packed into 64 bit words such
+ * that comparing two fingerprints is four integer compares.
+ */
+class Fingerprint
+{
+ public:
+    static const size_t MAX_SIZE = 32;
+
+    Fingerprint() : words_(), size_(0) {}
+
+    // returns false if hex is not a valid hex encoded fingerprint of at most MAX_SIZE bytes.
+    static bool fromHex(const std::string& hex, Fingerprint& out);
+    std::string toHex() const;
+
+    bool empty() const { return size_ == 0; }
+
+    bool operator==(const Fingerprint& other) const
+    {
+        return size_ == other.size_ &&
+            words_[0] == other.words_[0] &&
+            words_[1] == other.words_[1] &&
+            words_[2] == other.words_[2] &&
+            words_[3] == other.words_[3];
+    }
+    bool operator!=(const Fingerprint& other) const { return !(*this == other); }
+
+ private:
+    std::array<uint64_t, MAX_SIZE / sizeof(uint64_t)> words_;
+    uint8_t size_;
+};
+
+/**
+ * A string which is stored once in a process wide pool. Product ids
+ * are shared by all devices of a product and device ids are looked up
+ * on every request, interning them makes copies a pointer copy and
+ * equality a pointer compare. Ordering compares the strings, such that
+ * maps keyed by interned strings do not depend on the pool addresses.
+ */
+class InternedString
+{
+ public:
+    InternedString();
+    explicit InternedString(const std::string& str);
+
+    // Lookup without adding str to the pool, returns false if str has never been interned.
+    static bool find(const std::string& str, InternedString& out);
+
+    const std::string& str() const { return *str_; }
+    bool empty() const { return str_->empty(); }
+
+    bool operator==(const InternedString& other) const { return str_ == other.str_; }
+    bool operator!=(const InternedString& other) const { return str_ != other.str_; }
+    bool operator<(const InternedString& other) const { return str_ != other.str_ && *str_ < *other.str_; }
+
+ private:
+    const std::string* str_;
+};
+
+/**
+ * Attributes cached from the device the last time it was queried, such
+ * that bookmarks can be filtered without connecting to the devices.
+ */
+class DeviceAttributes
+{
+ public:
+    const std::string& getFriendlyName() const { return friendlyName_; }
+    const std::string& getAppName() const { return appName_; }
+    const std::vector<InternedString>& getServices() const { return services_; }
+
+    bool operator==(const DeviceAttributes& other) const
+    {
+        return friendlyName_ == other.friendlyName_ && appName_ == other.appName_ && services_ == other.services_;
+    }
+
+    std::string friendlyName_;
+    std::string appName_;
+    std::vector<InternedString> services_;
+};
+
+/**
+ * A host:port where the device can be reached directly, together with
+ * the outcome of the previous connects which used it.
+ */
+class DirectCandidate
+{
+ public:
+    static const uint16_t DEFAULT_PORT = 5592;
+
+    // Parse host, host:port, [ipv6] or [ipv6]:port.
+    static bool parse(const std::string& in, DirectCandidate& out, uint16_t defaultPort = DEFAULT_PORT);
+    std::string toString() const;
+
+    bool sameEndpoint(const DirectCandidate& other) const { return host_ == other.host_ && port_ == other.port_; }
+
+    std::string host_;
+    uint16_t port_ = DEFAULT_PORT;
+    // smoothed connect time when this candidate won, 0 if unknown.
+    uint32_t rttMs_ = 0;
+    uint32_t successes_ = 0;
+    // failures since the last success.
+    uint32_t failures_ = 0;
+};
+
 class DeviceInfo
 {
  public:
@@ -38,34 +147,116 @@ class DeviceInfo
     std::string getFriendlyName() const
     {
         std::stringstream ss;
-        ss << "[" << index_ << "] " << productId_ << "." << deviceId_;
+        ss << "[" << index_ << "] " << productId_.str() << "." << deviceId_.str();
         return ss.str();
     }
 
-    std::string getDeviceId() { return deviceId_; }
-    std::string getProductId() { return productId_; }
-    std::string getDeviceFingerprint() { return deviceFingerprint_; }
-    std::string getSct() { return sct_; }
-    std::string getDirectCandidate() { return directCandidate_; }
-    int getIndex() { return index_; }
-
-    int index_;
-    std::string deviceId_;
-    std::string productId_;
-    std::string deviceFingerprint_;
+    const std::string& getDeviceId() const { return deviceId_.str(); }
+    const std::string& getProductId() const { return productId_.str(); }
+    const Fingerprint& getDeviceFingerprint() const { return deviceFingerprint_; }
+    const std::string& getSct() const { return sct_; }
+    const std::vector<DirectCandidate>& getDirectCandidates() const { return directCandidates_; }
+    int getIndex() const { return index_; }
+    const std::vector<InternedString>& getTags() const { return tags_; }
+    const DeviceAttributes& getAttributes() const { return attributes_; }
+
+    int index_ = 0;
+    InternedString deviceId_;
+    InternedString productId_;
+    Fingerprint deviceFingerprint_;
     std::string sct_;
-    std::string directCandidate_;
+    std::vector<DirectCandidate> directCandidates_;
+    // user defined tags, e.g. the site the device is installed at.
+    std::vector<InternedString> tags_;
+    DeviceAttributes attributes_;
+};
+
+/**
+ * Bookmarks are published as immutable snapshots. Readers take a
+ * snapshot and use it without locks or copies, writers build a new
+ * snapshot and replace the current one.
+ */
+typedef std::map<int, std::shared_ptr<const DeviceInfo> > BookmarkMap;
+
+/**
+ * Inverted index from tags, services and device ids to bookmarks. An
+ * index is built once per bookmark snapshot and is immutable.
+ */
+class BookmarkIndex
+{
+ public:
+    BookmarkIndex(std::shared_ptr<const BookmarkMap> bookmarks);
+
+    const std::shared_ptr<const BookmarkMap>& getBookmarks() const { return bookmarks_; }
+
+    // Find the devices which have all the tags and all the services, no filters matches all devices.
+    std::vector<std::shared_ptr<const DeviceInfo> > query(const std::vector<std::string>& tags, const std::vector<std::string>& services) const;
+
+    std::shared_ptr<const DeviceInfo> find(const std::string& productId, const std::string& deviceId) const;
+    // Returns nullptr if no or several products have a device with the id.
+    std::shared_ptr<const DeviceInfo> findByDeviceId(const std::string& deviceId) const;
+
+ private:
+    // bookmark indexes are kept sorted such that posting lists can be intersected linearly.
+    typedef std::map<InternedString, std::vector<int> > PostingLists;
+    static bool intersect(const PostingLists& lists, const std::vector<std::string>& keys, std::vector<int>& result, bool& first);
+
+    std::shared_ptr<const BookmarkMap> bookmarks_;
+    PostingLists tags_;
+    PostingLists services_;
+    // device ids are only unique within a product.
+    std::map<std::pair<InternedString, InternedString>, int> devices_;
+    PostingLists deviceIds_;
+};
+
+/**
+ * Connection tuning from the "ConnectionOptions" section of the client
+ * configuration. Options which are not set are left at the SDK
+ * defaults.
+ */
+class ConnectionProfile
+{
+ public:
+    // json object with the SDK connection options, e.g. {"KeepAliveInterval":30000}.
+    std::string options_ = "{}";
+    bool local_ = true;
+    bool remote_ = true;
+    // port used for direct candidates given without a port.
+    uint16_t directCandidatePort_ = DirectCandidate::DEFAULT_PORT;
 };
 
 class ClientConfiguration {
  public:
-    ClientConfiguration(const std::string serverUrl)
-        : serverUrl_(serverUrl)
+    ClientConfiguration(const std::string serverUrl, bool hedgedConnect = false, const ConnectionProfile& defaultProfile = ConnectionProfile(), const std::map<std::string, ConnectionProfile>& deviceProfiles = std::map<std::string, ConnectionProfile>(), int idleConnectionTimeout = DEFAULT_IDLE_CONNECTION_TIMEOUT)
+        : serverUrl_(serverUrl), hedgedConnect_(hedgedConnect), defaultProfile_(defaultProfile), deviceProfiles_(deviceProfiles), idleConnectionTimeout_(idleConnectionTimeout)
     {
     }
+
+    static const int DEFAULT_IDLE_CONNECTION_TIMEOUT = 300;
+
     std::string getServerUrl() { return serverUrl_; }
+    // race local and remote connects when the best channel of a device is unknown.
+    bool getHedgedConnect() { return hedgedConnect_; }
+
+    const ConnectionProfile& getDefaultProfile() const { return defaultProfile_; }
+    // The profile for <productId>.<deviceId> or <deviceId>, else the default profile.
+    const ConnectionProfile& getConnectionProfile(const std::string& productId, const std::string& deviceId) const
+    {
+        auto it = deviceProfiles_.find(productId + "." + deviceId);
+        if (it == deviceProfiles_.end()) {
+            it = deviceProfiles_.find(deviceId);
+        }
+        return it == deviceProfiles_.end() ? defaultProfile_ : it->second;
+    }
+
+    // seconds without tunnels or requests before a connection is closed, 0 keeps connections open.
+    int getIdleConnectionTimeout() const { return idleConnectionTimeout_; }
  private:
     std::string serverUrl_;
+    bool hedgedConnect_;
+    ConnectionProfile defaultProfile_;
+    std::map<std::string, ConnectionProfile> deviceProfiles_;
+    int idleConnectionTimeout_;
 };
 
 void InitializeWithDirectory(const std::string &HomePath);
@@ -73,13 +264,21 @@ std::unique_ptr<ClientConfiguration> GetConfigInfo();
 const char* GetConfigFilePath();
 const char* GetStateFilePath();
 bool WriteStateFile();
-std::unique_ptr<DeviceInfo> GetPairedDevice(int Index);
-std::unique_ptr<DeviceInfo> GetPairedDevice(const std::string& fingerprint);
+std::shared_ptr<const DeviceInfo> GetPairedDevice(int Index);
+std::shared_ptr<const DeviceInfo> GetPairedDevice(const std::string& fingerprint);
+std::shared_ptr<const BookmarkMap> GetBookmarks();
+std::shared_ptr<const BookmarkIndex> GetBookmarkIndex();
+// add or remove a user defined tag on a bookmark and save the state file.
+bool SetBookmarkTag(int Index, const std::string& Tag, bool Present);
+// update the cached device attributes of a bookmark, the state file is only written if they changed.
+bool UpdateBookmarkAttributes(int Index, const DeviceAttributes& Attributes);
+// edit the direct candidates of a bookmark under the bookmark lock, the state file is only written if Edit returns true for a change.
+bool UpdateBookmarkDirectCandidates(int Index, std::function<bool (std::vector<DirectCandidate>& Candidates)> Edit);
 bool HasNoBookmarks();
 // insert info into bookmarks, and set the index into the info
 void AddPairedDeviceToBookmarks(DeviceInfo& Info);
 bool GetPrivateKey(std::shared_ptr<nabto::client::Context> Context, std::string& PrivateKey);
-std::map<int, Configuration::DeviceInfo> PrintBookmarks();
+std::shared_ptr<const BookmarkMap> PrintBookmarks();
 bool DeleteBookmark(const uint32_t& bookmark);
 
 bool makeDirectories(const std::string& in);
@@ -0,0 +1,320 @@
+#include "connect_strategy.hpp"
+
+#include <3rdparty/nlohmann/json.hpp>
+
+#include <algorithm>
+
+using json = nlohmann::json;
+
+// A local peer answers the DTLS hello within milliseconds, failing
+// fast leaves time for the remote fallback.
+static const int localOnlyDtlsHelloTimeoutMs = 2000;
+
+const int ConnectStrategy::candidateStaggerMs;
+const int ConnectStrategy::hedgeStaggerMs;
+const int ConnectStrategy::pairingTtlSeconds;
+const size_t ConnectStrategy::minLatencySamples;
+const int ConnectStrategy::timeoutMargin;
+const int ConnectStrategy::minTimeoutMs;
+const int ConnectStrategy::resumeWindowSeconds;
+const int ConnectStrategy::candidateWriteIntervalSeconds;
+
+std::vector<ConnectStrategy::Channels> ConnectStrategy::plan(const Configuration::DeviceInfo& device, bool hedged)
+{
+    nabto::examples::common::LocalDevice local;
+    if (discovery_ && discovery_->lookup(device.getProductId(), device.getDeviceId(), local)) {
+        return { Channels::LOCAL_ONLY, Channels::REMOTE_ONLY };
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = history_.find(key(device));
+    if (it != history_.end() &&
+        (it->second.lastChannels_ == Channels::LOCAL_ONLY || it->second.lastChannels_ == Channels::REMOTE_ONLY) &&
+        std::chrono::steady_clock::now() - it->second.lastSuccess_ < std::chrono::seconds(resumeWindowSeconds))
+    {
+        return { it->second.lastChannels_, Channels::ANY };
+    }
+    if (it != history_.end() && it->second.remoteSuccess_ && !it->second.localSuccess_) {
+        return { Channels::REMOTE_ONLY, Channels::ANY };
+    }
+    if (hedged) {
+        return { Channels::HEDGED };
+    }
+    return { Channels::ANY };
+}
+
+void ConnectStrategy::recordOutcome(const Configuration::DeviceInfo& device, Channels channels, bool success, std::chrono::milliseconds elapsed)
+{
+    if (!success) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    History& h = history_[key(device)];
+    h.lastSuccess_ = std::chrono::steady_clock::now();
+    h.lastChannels_ = channels;
+    h.latency_[channels].add((uint32_t)std::max<int64_t>(1, elapsed.count()));
+    if (channels == Channels::LOCAL_ONLY) {
+        h.localSuccess_ = true;
+    } else if (channels == Channels::REMOTE_ONLY) {
+        h.remoteSuccess_ = true;
+    }
+}
+
+void ConnectStrategy::recordReachedChannels(const Configuration::DeviceInfo& device, bool local, bool remote)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    History& h = history_[key(device)];
+    h.localSuccess_ = h.localSuccess_ || local;
+    h.remoteSuccess_ = h.remoteSuccess_ || remote;
+}
+
+uint32_t ConnectStrategy::LatencyHistory::percentile(double p) const
+{
+    if (count_ == 0) {
+        return 0;
+    }
+    std::vector<uint32_t> sorted(samples_.begin(), samples_.begin() + count_);
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = (size_t)(p * (count_ - 1) + 0.5);
+    return sorted[std::min(rank, count_ - 1)];
+}
+
+int ConnectStrategy::connectTimeoutMs(const Configuration::DeviceInfo& device, Channels channels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = history_.find(key(device));
+    if (it == history_.end()) {
+        return 0;
+    }
+    auto l = it->second.latency_.find(channels);
+    if (l == it->second.latency_.end() || l->second.count() < minLatencySamples) {
+        return 0;
+    }
+    return std::max<int>(minTimeoutMs, (int)l->second.percentile(0.99) * timeoutMargin);
+}
+
+std::string ConnectStrategy::options(const Configuration::DeviceInfo& device, const Configuration::ConnectionProfile& profile, Channels channels)
+{
+    return options(channels, connectTimeoutMs(device, channels), profile);
+}
+
+std::vector<ConnectStrategy::Channels> ConnectStrategy::allowedChannels(const std::vector<Channels>& plan, const Configuration::ConnectionProfile& profile)
+{
+    std::vector<Channels> allowed;
+    for (auto channels : plan) {
+        if (channels == Channels::HEDGED && !(profile.local_ && profile.remote_)) {
+            channels = Channels::ANY;
+        }
+        if ((channels == Channels::LOCAL_ONLY && !profile.local_) ||
+            (channels == Channels::REMOTE_ONLY && !profile.remote_) ||
+            std::find(allowed.begin(), allowed.end(), channels) != allowed.end())
+        {
+            continue;
+        }
+        allowed.push_back(channels);
+    }
+    if (allowed.empty()) {
+        allowed.push_back(Channels::ANY);
+    }
+    return allowed;
+}
+
+bool ConnectStrategy::isPairingVerified(const Configuration::DeviceInfo& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = history_.find(key(device));
+    if (it == history_.end() || it->second.verifiedFingerprint_.empty()) {
+        return false;
+    }
+    return it->second.verifiedFingerprint_ == device.getDeviceFingerprint() &&
+        std::chrono::steady_clock::now() - it->second.verifiedAt_ < std::chrono::seconds(pairingTtlSeconds);
+}
+
+void ConnectStrategy::markPairingVerified(const Configuration::DeviceInfo& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    History& h = history_[key(device)];
+    h.verifiedFingerprint_ = device.getDeviceFingerprint();
+    h.verifiedAt_ = std::chrono::steady_clock::now();
+}
+
+void ConnectStrategy::invalidatePairing(const Configuration::DeviceInfo& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = history_.find(key(device));
+    if (it != history_.end()) {
+        it->second.verifiedFingerprint_ = Configuration::Fingerprint();
+    }
+}
+
+std::vector<Configuration::DirectCandidate> ConnectStrategy::rankCandidates(const std::vector<Configuration::DirectCandidate>& candidates)
+{
+    std::vector<Configuration::DirectCandidate> ranked = candidates;
+    // stable such that untried candidates keep the configured order.
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Configuration::DirectCandidate& a, const Configuration::DirectCandidate& b) {
+            bool aFailing = a.failures_ > 0;
+            bool bFailing = b.failures_ > 0;
+            if (aFailing != bFailing) {
+                return bFailing;
+            }
+            if (aFailing) {
+                return a.failures_ < b.failures_;
+            }
+            // a known rtt beats an unknown rtt.
+            uint32_t aRtt = a.rttMs_ ? a.rttMs_ : UINT32_MAX;
+            uint32_t bRtt = b.rttMs_ ? b.rttMs_ : UINT32_MAX;
+            return aRtt < bRtt;
+        });
+    return ranked;
+}
+
+std::vector<Configuration::DirectCandidate> ConnectStrategy::rankCandidates(const Configuration::DeviceInfo& device)
+{
+    std::vector<Configuration::DirectCandidate> candidates = device.getDirectCandidates();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = history_.find(key(device));
+        if (it != history_.end()) {
+            for (auto& c : candidates) {
+                for (const auto& s : it->second.candidates_) {
+                    if (c.sameEndpoint(s)) {
+                        c.rttMs_ = s.rttMs_;
+                        c.successes_ = s.successes_;
+                        c.failures_ = s.failures_;
+                    }
+                }
+            }
+        }
+    }
+    return rankCandidates(candidates);
+}
+
+void ConnectStrategy::recordDirectCandidates(const Configuration::DeviceInfo& device, const std::vector<Configuration::DirectCandidate>& offered, bool success, bool exact, std::chrono::milliseconds elapsed)
+{
+    if (offered.empty() || (success && !exact)) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Configuration::DirectCandidate> stats;
+    int index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        History& h = history_[key(device)];
+        h.index_ = device.getIndex();
+        if (h.candidates_.empty()) {
+            // the bookmark was written with the stats it was loaded with.
+            h.candidatesWritten_ = now;
+        }
+        for (auto& o : offered) {
+            auto it = std::find_if(h.candidates_.begin(), h.candidates_.end(), [&o](const Configuration::DirectCandidate& c) { return c.sameEndpoint(o); });
+            if (it == h.candidates_.end()) {
+                // the offered candidate carries the stats of the bookmark.
+                h.candidates_.push_back(o);
+            }
+        }
+        auto before = rankCandidates(h.candidates_);
+        for (auto& c : h.candidates_) {
+            for (auto& o : offered) {
+                if (!c.sameEndpoint(o)) {
+                    continue;
+                }
+                if (success) {
+                    uint32_t rtt = (uint32_t)std::max<int64_t>(1, elapsed.count());
+                    // exponentially weighted with alpha 1/4 like the TCP smoothed rtt.
+                    c.rttMs_ = c.rttMs_ == 0 ? rtt : (3 * c.rttMs_ + rtt) / 4;
+                    c.successes_++;
+                    c.failures_ = 0;
+                } else {
+                    c.failures_++;
+                }
+            }
+        }
+        h.candidatesChanged_ = true;
+        auto after = rankCandidates(h.candidates_);
+        bool reordered = !std::equal(before.begin(), before.end(), after.begin(), [](const Configuration::DirectCandidate& a, const Configuration::DirectCandidate& b) { return a.sameEndpoint(b); });
+        if (!reordered && now - h.candidatesWritten_ < std::chrono::seconds(candidateWriteIntervalSeconds)) {
+            return;
+        }
+        stats = h.candidates_;
+        index = h.index_;
+        h.candidatesChanged_ = false;
+        h.candidatesWritten_ = now;
+    }
+    writeCandidateStats(index, stats);
+}
+
+void ConnectStrategy::writeCandidateStats()
+{
+    std::vector<std::pair<int, std::vector<Configuration::DirectCandidate> > > pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : history_) {
+            History& h = entry.second;
+            if (h.candidatesChanged_) {
+                pending.push_back(std::make_pair(h.index_, h.candidates_));
+                h.candidatesChanged_ = false;
+                h.candidatesWritten_ = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    for (const auto& p : pending) {
+        writeCandidateStats(p.first, p.second);
+    }
+}
+
+void ConnectStrategy::writeCandidateStats(int index, const std::vector<Configuration::DirectCandidate>& stats)
+{
+    // under the bookmark lock such that a concurrent edit of the candidates is kept.
+    Configuration::UpdateBookmarkDirectCandidates(index, [&stats](std::vector<Configuration::DirectCandidate>& candidates) {
+            bool changed = false;
+            for (auto& c : candidates) {
+                for (const auto& s : stats) {
+                    if (c.sameEndpoint(s) &&
+                        (c.rttMs_ != s.rttMs_ || c.successes_ != s.successes_ || c.failures_ != s.failures_))
+                    {
+                        c.rttMs_ = s.rttMs_;
+                        c.successes_ = s.successes_;
+                        c.failures_ = s.failures_;
+                        changed = true;
+                    }
+                }
+            }
+            return changed;
+        });
+}
+
+std::string ConnectStrategy::options(bool local, bool remote)
+{
+    json options;
+    options["Local"] = local;
+    options["Remote"] = remote;
+    return options.dump();
+}
+
+std::string ConnectStrategy::options(Channels channels, int dtlsHelloTimeoutMs, const Configuration::ConnectionProfile& profile)
+{
+    json options = json::parse(profile.options_);
+    if (channels == Channels::LOCAL_ONLY) {
+        options["Remote"] = false;
+        if (!options.contains("DtlsHelloTimeout")) {
+            options["DtlsHelloTimeout"] = localOnlyDtlsHelloTimeoutMs;
+        }
+    } else if (channels == Channels::REMOTE_ONLY) {
+        options["Local"] = false;
+    }
+    // a learned timeout can only make a dead device fail faster.
+    if (dtlsHelloTimeoutMs > 0 && (!options.contains("DtlsHelloTimeout") || dtlsHelloTimeoutMs < options["DtlsHelloTimeout"].get<int>())) {
+        options["DtlsHelloTimeout"] = dtlsHelloTimeoutMs;
+    }
+    return options.dump();
+}
+
+const char* ConnectStrategy::channelsAsString(Channels channels)
+{
+    switch (channels) {
+        case Channels::LOCAL_ONLY: return "local";
+        case Channels::REMOTE_ONLY: return "remote";
+        case Channels::HEDGED: return "hedged";
+        default: return "any";
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "config.hpp"
+#include "local_discovery.hpp"
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Decides which channels a connect attempt should use. A device which
+ * is currently visible on the LAN is tried local only first with a
+ * short DTLS hello timeout and then remote only. A device which has
+ * only ever been reached remotely and is not visible on the LAN skips
+ * the local mDNS lookup entirely. Everything else uses the SDK
+ * default of trying all channels at once, or if hedging is enabled a
+ * local and a remote connection racing each other. A device which is
+ * reconnected shortly after it was last connected resumes with the
+ * channel set which connected last time.
+ */
+class ConnectStrategy {
+ public:
+    enum class Channels {
+        ANY,
+        LOCAL_ONLY,
+        REMOTE_ONLY,
+        // LOCAL_ONLY and a staggered REMOTE_ONLY in parallel, the first to connect wins.
+        HEDGED
+    };
+
+    ConnectStrategy() {}
+    ConnectStrategy(std::shared_ptr<nabto::examples::common::LocalDiscovery> discovery)
+        : discovery_(discovery)
+    {
+    }
+
+    // The channel sets to try in order, the first which connects wins.
+    std::vector<Channels> plan(const Configuration::DeviceInfo& device, bool hedged = false);
+
+    // elapsed is the time the connect took, successful connects feed the latency history of the channel set.
+    void recordOutcome(const Configuration::DeviceInfo& device, Channels channels, bool success, std::chrono::milliseconds elapsed);
+
+    /**
+     * Record which channels reached the device in a connect which
+     * tried all channels, such that a device which is only reachable
+     * remotely gets the plan which skips the mDNS lookup.
+     */
+    void recordReachedChannels(const Configuration::DeviceInfo& device, bool local, bool remote);
+
+    /**
+     * Connect timeout learned from the latency history of the device
+     * and channel set, the p99 connect time times timeoutMargin.
+     * Returns 0 until minLatencySamples connects have been recorded,
+     * in which case the SDK defaults are used.
+     */
+    int connectTimeoutMs(const Configuration::DeviceInfo& device, Channels channels);
+
+    // Connection options json for a channel set on top of the configured profile, including the learned DtlsHelloTimeout.
+    std::string options(const Configuration::DeviceInfo& device, const Configuration::ConnectionProfile& profile, Channels channels);
+
+    static const size_t minLatencySamples = 5;
+    static const int timeoutMargin = 2;
+    static const int minTimeoutMs = 1000;
+
+    /**
+     * The direct candidates ordered by past performance. Candidates
+     * which have failed since their last success go last, otherwise
+     * the lowest recorded connect time goes first.
+     */
+    static std::vector<Configuration::DirectCandidate> rankCandidates(const std::vector<Configuration::DirectCandidate>& candidates);
+
+    // The direct candidates of the bookmark with the stats recorded since they were last written, ranked.
+    std::vector<Configuration::DirectCandidate> rankCandidates(const Configuration::DeviceInfo& device);
+
+    /**
+     * Record the outcome of the direct candidates channel. The SDK
+     * does not tell which candidate won, so a success is only credited
+     * when a single candidate was offered (exact), a failure is
+     * charged to every offered candidate. The stats are kept in memory
+     * and only written to the state file when they change the ranking
+     * of the candidates, or candidateWriteIntervalSeconds after the
+     * last write.
+     */
+    void recordDirectCandidates(const Configuration::DeviceInfo& device, const std::vector<Configuration::DirectCandidate>& offered, bool success, bool exact, std::chrono::milliseconds elapsed);
+
+    // Write the candidate stats which have not been written yet, on shutdown.
+    void writeCandidateStats();
+
+    static const int candidateWriteIntervalSeconds = 300;
+
+    // The best candidate is offered alone for this long before the rest are added.
+    static const int candidateStaggerMs = 250;
+
+    // A hedged connect starts the remote attempt this long after the local attempt.
+    static const int hedgeStaggerMs = 150;
+
+    /**
+     * Pairing verification cache. A device whose pairing (IAM get me)
+     * was verified with the same fingerprint within pairingTtl does
+     * not need the extra CoAP round trip on connect. A 403 from the
+     * device invalidates the cached verification.
+     */
+    bool isPairingVerified(const Configuration::DeviceInfo& device);
+    void markPairingVerified(const Configuration::DeviceInfo& device);
+    void invalidatePairing(const Configuration::DeviceInfo& device);
+
+    static const int pairingTtlSeconds = 300;
+
+    // A device reconnected within this long of its last connect starts with the channel set which connected last time.
+    static const int resumeWindowSeconds = 600;
+
+    // Connection options json for a channel set.
+    static std::string options(Channels channels, int dtlsHelloTimeoutMs = 0, const Configuration::ConnectionProfile& profile = Configuration::ConnectionProfile());
+
+    // The channel sets of a plan which the profile allows, a hedged connect needs both local and remote.
+    static std::vector<Channels> allowedChannels(const std::vector<Channels>& plan, const Configuration::ConnectionProfile& profile);
+
+    static std::string options(bool local, bool remote);
+
+    static const char* channelsAsString(Channels channels);
+
+ private:
+    typedef std::pair<Configuration::InternedString, Configuration::InternedString> DeviceKey;
+
+    // The latest connect times of a channel set in a ring buffer.
+    class LatencyHistory {
+     public:
+        void add(uint32_t ms)
+        {
+            samples_[next_] = ms;
+            next_ = (next_ + 1) % samples_.size();
+            if (count_ < samples_.size()) {
+                count_++;
+            }
+        }
+        size_t count() const { return count_; }
+        uint32_t percentile(double p) const;
+     private:
+        std::array<uint32_t, 32> samples_ = {};
+        size_t next_ = 0;
+        size_t count_ = 0;
+    };
+
+    class History {
+     public:
+        bool localSuccess_ = false;
+        bool remoteSuccess_ = false;
+        std::chrono::steady_clock::time_point lastSuccess_;
+        Channels lastChannels_ = Channels::ANY;
+        Configuration::Fingerprint verifiedFingerprint_;
+        std::chrono::steady_clock::time_point verifiedAt_;
+        std::map<Channels, LatencyHistory> latency_;
+        // the direct candidate stats, ahead of the bookmark until they are written.
+        std::vector<Configuration::DirectCandidate> candidates_;
+        bool candidatesChanged_ = false;
+        std::chrono::steady_clock::time_point candidatesWritten_;
+        int index_ = 0;
+    };
+
+    // Copy the stats of the candidates into the bookmark at index, the state file is written if they differ.
+    static void writeCandidateStats(int index, const std::vector<Configuration::DirectCandidate>& stats);
+
+    static DeviceKey key(const Configuration::DeviceInfo& device)
+    {
+        return std::make_pair(device.productId_, device.deviceId_);
+    }
+
+    std::shared_ptr<nabto::examples::common::LocalDiscovery> discovery_;
+    std::mutex mutex_;
+    std::map<DeviceKey, History> history_;
+};
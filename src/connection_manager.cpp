@@ -0,0 +1,152 @@
+#include "connection_manager.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+ConnectionManager::ConnectionManager(ConnectFunction connect, std::chrono::seconds idleTimeout)
+    : connect_(connect), idleTimeout_(idleTimeout)
+{
+    if (idleTimeout_.count() > 0) {
+        reaper_ = std::thread(&ConnectionManager::reaper, this);
+    }
+}
+
+ConnectionManager::~ConnectionManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    stopCond_.notify_all();
+    if (reaper_.joinable()) {
+        reaper_.join();
+    }
+}
+
+std::shared_ptr<ConnectionManager::Entry> ConnectionManager::entry(const Configuration::DeviceInfo& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& e = entries_[key(device)];
+    if (!e) {
+        e = std::make_shared<Entry>();
+    }
+    return e;
+}
+
+std::shared_ptr<nabto::client::Connection> ConnectionManager::get(const Configuration::DeviceInfo& device)
+{
+    auto e = entry(device);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        e->lastUsed_ = std::chrono::steady_clock::now();
+        if (e->connection_) {
+            return e->connection_;
+        }
+    }
+
+    std::lock_guard<std::mutex> connectLock(e->connectMutex_);
+    {
+        // another request may have connected while we waited.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (e->connection_) {
+            return e->connection_;
+        }
+    }
+    auto connection = connect_(device);
+    std::lock_guard<std::mutex> lock(mutex_);
+    e->connection_ = connection;
+    e->lastUsed_ = std::chrono::steady_clock::now();
+    return connection;
+}
+
+void ConnectionManager::addTunnel(const Configuration::DeviceInfo& device, std::shared_ptr<nabto::client::TcpTunnel> tunnel)
+{
+    auto e = entry(device);
+    std::lock_guard<std::mutex> lock(mutex_);
+    e->tunnels_.push_back(tunnel);
+    e->lastUsed_ = std::chrono::steady_clock::now();
+}
+
+void ConnectionManager::clearTunnels(const Configuration::DeviceInfo& device)
+{
+    std::vector<std::shared_ptr<nabto::client::TcpTunnel> > tunnels;
+    auto e = entry(device);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tunnels.swap(e->tunnels_);
+        e->lastUsed_ = std::chrono::steady_clock::now();
+    }
+    // the tunnels are freed outside the lock.
+}
+
+void ConnectionManager::invalidate(const Configuration::DeviceInfo& device)
+{
+    std::shared_ptr<nabto::client::Connection> connection;
+    std::vector<std::shared_ptr<nabto::client::TcpTunnel> > tunnels;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key(device));
+        if (it == entries_.end()) {
+            return;
+        }
+        connection.swap(it->second->connection_);
+        tunnels.swap(it->second->tunnels_);
+    }
+    close(connection);
+}
+
+size_t ConnectionManager::evictIdle()
+{
+    std::vector<std::shared_ptr<nabto::client::Connection> > idle;
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& e : entries_) {
+            if (e.second->connection_ && e.second->tunnels_.empty() && now - e.second->lastUsed_ >= idleTimeout_) {
+                idle.push_back(e.second->connection_);
+                e.second->connection_.reset();
+            }
+        }
+    }
+    for (auto& c : idle) {
+        close(c);
+    }
+    return idle.size();
+}
+
+size_t ConnectionManager::connectedCount()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::count_if(entries_.begin(), entries_.end(), [](const std::pair<const DeviceKey, std::shared_ptr<Entry> >& e) { return e.second->connection_ != nullptr; });
+}
+
+void ConnectionManager::close(std::shared_ptr<nabto::client::Connection> connection)
+{
+    if (!connection) {
+        return;
+    }
+    try {
+        connection->close()->waitForResult();
+    } catch (nabto::client::NabtoException& e) {
+        // the connection is already closed, e.g. the device went away.
+    }
+}
+
+void ConnectionManager::reaper()
+{
+    // check a few times per idle timeout such that connections do not live much longer than it.
+    auto interval = std::max(std::chrono::seconds(1), idleTimeout_ / 4);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_) {
+        stopCond_.wait_for(lock, interval);
+        if (stopped_) {
+            break;
+        }
+        lock.unlock();
+        size_t evicted = evictIdle();
+        if (evicted > 0) {
+            std::cout << "Closed " << evicted << " idle connection(s)" << std::endl;
+        }
+        lock.lock();
+    }
+}
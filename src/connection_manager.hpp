@@ -0,0 +1,78 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <nabto_client.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Keeps at most one connection per bookmarked device. A connection
+ * which has had no open tunnels and no requests for idleTimeout is
+ * closed, such that keep alive traffic and memory follow the active
+ * devices and not the bookmarked ones. The next request for an evicted
+ * device reconnects lazily through the connect function, which reuses
+ * the channel, options and pairing knowledge the ConnectStrategy kept
+ * from the previous connection.
+ */
+class ConnectionManager {
+ public:
+    typedef std::function<std::shared_ptr<nabto::client::Connection>(const Configuration::DeviceInfo&)> ConnectFunction;
+
+    // An idleTimeout of zero never evicts connections.
+    ConnectionManager(ConnectFunction connect, std::chrono::seconds idleTimeout);
+    ~ConnectionManager();
+
+    // The connection to the device, connecting it if it is not connected. Returns nullptr if the connect fails.
+    std::shared_ptr<nabto::client::Connection> get(const Configuration::DeviceInfo& device);
+
+    // Tunnels keep the connection of the device from being evicted.
+    void addTunnel(const Configuration::DeviceInfo& device, std::shared_ptr<nabto::client::TcpTunnel> tunnel);
+    void clearTunnels(const Configuration::DeviceInfo& device);
+
+    // Drop the connection of a device, e.g. after it failed, the next get reconnects.
+    void invalidate(const Configuration::DeviceInfo& device);
+
+    // Close the connections which have been idle for idleTimeout, returns the number closed.
+    size_t evictIdle();
+
+    size_t connectedCount();
+
+ private:
+    typedef std::pair<Configuration::InternedString, Configuration::InternedString> DeviceKey;
+
+    class Entry {
+     public:
+        // serializes connects to the device such that concurrent requests share one connect.
+        std::mutex connectMutex_;
+        std::shared_ptr<nabto::client::Connection> connection_;
+        std::vector<std::shared_ptr<nabto::client::TcpTunnel> > tunnels_;
+        std::chrono::steady_clock::time_point lastUsed_;
+    };
+
+    static DeviceKey key(const Configuration::DeviceInfo& device)
+    {
+        return std::make_pair(device.productId_, device.deviceId_);
+    }
+
+    std::shared_ptr<Entry> entry(const Configuration::DeviceInfo& device);
+    static void close(std::shared_ptr<nabto::client::Connection> connection);
+    void reaper();
+
+    ConnectFunction connect_;
+    std::chrono::seconds idleTimeout_;
+    std::mutex mutex_;
+    std::map<DeviceKey, std::shared_ptr<Entry> > entries_;
+
+    std::condition_variable stopCond_;
+    bool stopped_ = false;
+    std::thread reaper_;
+};
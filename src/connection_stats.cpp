@@ -0,0 +1,184 @@
+#include "connection_stats.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+class ConnectionStats::EventsListener : public nabto::client::ConnectionEventsCallback {
+ public:
+    EventsListener(std::weak_ptr<ConnectionStats> stats, const DeviceKey& device, std::weak_ptr<nabto::client::Connection> connection)
+        : stats_(stats), device_(device), connection_(connection)
+    {
+    }
+
+    void onEvent(int event) {
+        auto stats = stats_.lock();
+        if (stats) {
+            stats->onEvent(device_, connection_, event);
+        }
+    }
+
+ private:
+    std::weak_ptr<ConnectionStats> stats_;
+    DeviceKey device_;
+    std::weak_ptr<nabto::client::Connection> connection_;
+};
+
+const size_t ConnectionStats::defaultCapacity;
+const int ConnectionStats::defaultIntervalMs;
+
+std::shared_ptr<ConnectionStats> ConnectionStats::create(std::chrono::milliseconds interval, size_t capacity)
+{
+    return std::make_shared<ConnectionStats>(interval, capacity);
+}
+
+ConnectionStats::ConnectionStats(std::chrono::milliseconds interval, size_t capacity)
+    : interval_(interval), capacity_(std::max<size_t>(1, capacity))
+{
+    sampler_ = std::thread(&ConnectionStats::sampler, this);
+}
+
+ConnectionStats::~ConnectionStats()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    stopCond_.notify_all();
+    if (sampler_.joinable()) {
+        sampler_.join();
+    }
+}
+
+void ConnectionStats::attach(const Configuration::DeviceInfo& device, std::shared_ptr<nabto::client::Connection> connection)
+{
+    Tracked t;
+    t.device_ = std::make_pair(device.productId_, device.deviceId_);
+    t.connection_ = connection;
+    t.listener_ = std::make_shared<EventsListener>(shared_from_this(), t.device_, connection);
+    connection->addEventsListener(t.listener_);
+    record(t.device_, read(*connection, nabto::client::ConnectionEventsCallback::CONNECTED()));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracked_.push_back(t);
+}
+
+ConnectionSample ConnectionStats::read(nabto::client::Connection& connection, int event)
+{
+    ConnectionSample s;
+    s.time_ = std::chrono::system_clock::now();
+    s.event_ = event;
+    try {
+        s.type_ = connection.getType();
+        s.info_ = connection.getInfo();
+        s.localChannelErrorCode_ = connection.getLocalChannelErrorCode();
+        s.remoteChannelErrorCode_ = connection.getRemoteChannelErrorCode();
+        s.directCandidatesChannelErrorCode_ = connection.getDirectCandidatesChannelErrorCode();
+    } catch (nabto::client::NabtoException& e) {
+        // the connection is not connected (anymore).
+        s.connected_ = false;
+    }
+    if (event == nabto::client::ConnectionEventsCallback::CLOSED()) {
+        s.connected_ = false;
+    }
+    return s;
+}
+
+void ConnectionStats::setChannelChangedHandler(ChannelChangedHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    channelChanged_ = handler;
+}
+
+void ConnectionStats::record(const DeviceKey& device, const ConnectionSample& sample)
+{
+    bool fellBack = false;
+    ChannelChangedHandler changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Ring& r = series_[device];
+        if (sample.connected_ && r.hasLast_ && r.last_.connected_ && sample.type_ != r.last_.type_) {
+            changed = channelChanged_;
+            if (sample.type_ == nabto::client::Connection::Type::RELAY) {
+                r.relayFallbacks_++;
+                fellBack = true;
+            }
+        }
+        if (r.samples_.size() < capacity_) {
+            r.samples_.push_back(sample);
+        } else {
+            r.samples_[r.next_] = sample;
+        }
+        r.next_ = (r.next_ + 1) % capacity_;
+        r.last_ = sample;
+        r.hasLast_ = true;
+    }
+    if (fellBack) {
+        std::cerr << "The connection to " << device.first.str() << "." << device.second.str() << " fell back from direct to relay" << std::endl;
+    }
+    if (changed) {
+        changed(device.first, device.second, sample.type_);
+    }
+}
+
+void ConnectionStats::onEvent(const DeviceKey& device, std::weak_ptr<nabto::client::Connection> connection, int event)
+{
+    auto c = connection.lock();
+    if (!c) {
+        return;
+    }
+    record(device, read(*c, event));
+}
+
+void ConnectionStats::sample()
+{
+    std::vector<std::pair<DeviceKey, std::shared_ptr<nabto::client::Connection> > > live;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tracked_.erase(std::remove_if(tracked_.begin(), tracked_.end(), [](const Tracked& t) { return t.connection_.expired(); }), tracked_.end());
+        for (const auto& t : tracked_) {
+            auto c = t.connection_.lock();
+            if (c) {
+                live.push_back(std::make_pair(t.device_, c));
+            }
+        }
+    }
+    // the connections are read outside the lock, the getters call into the SDK.
+    for (const auto& l : live) {
+        record(l.first, read(*l.second, 0));
+    }
+}
+
+std::vector<ConnectionSeries> ConnectionStats::getSeries()
+{
+    std::vector<ConnectionSeries> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& s : series_) {
+        ConnectionSeries series;
+        series.productId_ = s.first.first.str();
+        series.deviceId_ = s.first.second.str();
+        series.relayFallbacks_ = s.second.relayFallbacks_;
+        const auto& samples = s.second.samples_;
+        if (samples.size() < capacity_) {
+            series.samples_ = samples;
+        } else {
+            series.samples_.insert(series.samples_.end(), samples.begin() + s.second.next_, samples.end());
+            series.samples_.insert(series.samples_.end(), samples.begin(), samples.begin() + s.second.next_);
+        }
+        result.push_back(series);
+    }
+    return result;
+}
+
+void ConnectionStats::sampler()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_) {
+        stopCond_.wait_for(lock, interval_);
+        if (stopped_) {
+            break;
+        }
+        lock.unlock();
+        sample();
+        lock.lock();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <nabto_client.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ConnectionSample {
+ public:
+    std::chrono::system_clock::time_point time_;
+    // the connection event which caused the sample, 0 for periodic samples.
+    int event_ = 0;
+    bool connected_ = true;
+    nabto::client::Connection::Type type_ = nabto::client::Connection::Type::RELAY;
+    // the json connection info from the SDK.
+    std::string info_;
+    int localChannelErrorCode_ = 0;
+    int remoteChannelErrorCode_ = 0;
+    int directCandidatesChannelErrorCode_ = 0;
+};
+
+class ConnectionSeries {
+ public:
+    std::string productId_;
+    std::string deviceId_;
+    // oldest sample first.
+    std::vector<ConnectionSample> samples_;
+    // times the connection went from direct to relay.
+    uint32_t relayFallbacks_ = 0;
+};
+
+/**
+ * Samples the channel type, info and channel error codes of the
+ * attached connections every interval and on every connection event.
+ * The samples of a device are kept in a fixed size ring such that the
+ * memory use does not grow with the uptime. A connection which moves
+ * from a direct channel to the relay is counted and logged, as relay
+ * fallback is the usual cause of poor tunnel throughput. A channel
+ * changed handler is told whenever the channel type of a connection
+ * changes, in either direction.
+ */
+class ConnectionStats : public std::enable_shared_from_this<ConnectionStats> {
+ public:
+    static std::shared_ptr<ConnectionStats> create(std::chrono::milliseconds interval, size_t capacity = defaultCapacity);
+
+    ConnectionStats(std::chrono::milliseconds interval, size_t capacity);
+    ~ConnectionStats();
+
+    // Start sampling a connection, the connection is dropped from sampling when it is freed.
+    void attach(const Configuration::DeviceInfo& device, std::shared_ptr<nabto::client::Connection> connection);
+
+    void sample();
+
+    typedef std::function<void(const Configuration::InternedString& productId, const Configuration::InternedString& deviceId, nabto::client::Connection::Type type)> ChannelChangedHandler;
+    // Called outside the stats lock with the new channel type.
+    void setChannelChangedHandler(ChannelChangedHandler handler);
+
+    std::vector<ConnectionSeries> getSeries();
+
+    static const size_t defaultCapacity = 120;
+    static const int defaultIntervalMs = 5000;
+
+ private:
+    typedef std::pair<Configuration::InternedString, Configuration::InternedString> DeviceKey;
+
+    class Ring {
+     public:
+        std::vector<ConnectionSample> samples_;
+        size_t next_ = 0;
+        uint32_t relayFallbacks_ = 0;
+        bool hasLast_ = false;
+        ConnectionSample last_;
+    };
+
+    class Tracked {
+     public:
+        DeviceKey device_;
+        std::weak_ptr<nabto::client::Connection> connection_;
+        std::shared_ptr<nabto::client::ConnectionEventsCallback> listener_;
+    };
+
+    class EventsListener;
+
+    static ConnectionSample read(nabto::client::Connection& connection, int event);
+    void record(const DeviceKey& device, const ConnectionSample& sample);
+    void onEvent(const DeviceKey& device, std::weak_ptr<nabto::client::Connection> connection, int event);
+    void sampler();
+
+    std::chrono::milliseconds interval_;
+    size_t capacity_;
+    std::mutex mutex_;
+    std::vector<Tracked> tracked_;
+    std::map<DeviceKey, Ring> series_;
+    ChannelChangedHandler channelChanged_;
+
+    std::condition_variable stopCond_;
+    bool stopped_ = false;
+    std::thread sampler_;
+};
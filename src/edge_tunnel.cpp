@@ -6,6 +6,11 @@
 #include "timestamp.hpp"
 #include "iam.hpp"
 #include "iam_interactive.hpp"
+#include "local_discovery.hpp"
+#include "connect_strategy.hpp"
+#include "connection_manager.hpp"
+#include "connection_stats.hpp"
+#include "cbor_decoder.hpp"
 #include "version.hpp"
 #include <sstream> // Per std::ostringstream
 #include <3rdparty/cxxopts.hpp>
@@ -16,16 +21,14 @@
 #include <stdio.h>
 #include <thread>
 #include <future>
+#include <condition_variable>
 #include <map>
+#include <algorithm>
 
 using json = nlohmann::json;
 
 const std::string appName = "edge_tunnel_client";
 
-enum {
-  COAP_CONTENT_FORMAT_APPLICATION_CBOR = 60
-};
-
 // TODO reconnect when connection is closed.
 
 std::string generalHelp = R"(This client application is designed to be used with a tcp tunnel
@@ -104,7 +107,7 @@ class CloseListener : public nabto::client::ConnectionEventsCallback {
     std::promise<void> promise_;
 };
 
-void handleFingerprintMismatch(std::shared_ptr<nabto::client::Connection> connection, Configuration::DeviceInfo device)
+void handleFingerprintMismatch(std::shared_ptr<nabto::client::Connection> connection, const Configuration::DeviceInfo& device)
 {
     IAM::IAMError ec;
     std::unique_ptr<IAM::PairingInfo> pairingInfo;
@@ -123,46 +126,90 @@ void handleFingerprintMismatch(std::shared_ptr<nabto::client::Connection> connec
     }
 }
 
-std::shared_ptr<nabto::client::Connection> createConnection(std::shared_ptr<nabto::client::Context> context, Configuration::DeviceInfo device)
+static std::shared_ptr<nabto::client::Connection> newConnection(std::shared_ptr<nabto::client::Context> context, const Configuration::DeviceInfo& device, Configuration::ClientConfiguration& Config, const std::string& privateKey, ConnectStrategy& strategy, ConnectStrategy::Channels channels)
 {
-    auto Config = Configuration::GetConfigInfo();
-    if (!Config) {
-        printMissingClientConfig(Configuration::GetConfigFilePath());
-        return nullptr;
-    }
-
     auto connection = context->createConnection();
     connection->setProductId(device.getProductId());
     connection->setDeviceId(device.getDeviceId());
     connection->setApplicationName(appName);
     connection->setApplicationVersion(edge_tunnel_client_version());
+    connection->setOptions(strategy.options(device, Config.getConnectionProfile(device.getProductId(), device.getDeviceId()), channels));
+    connection->setPrivateKey(privateKey);
 
-    if (!device.getDirectCandidate().empty()) {
-        connection->enableDirectCandidates();
-        connection->addDirectCandidate(device.getDirectCandidate(), 5592);
-        connection->endOfDirectCandidates();
+    if (!Config.getServerUrl().empty()) {
+        connection->setServerUrl(Config.getServerUrl());
     }
 
-    std::string privateKey;
-    if(!Configuration::GetPrivateKey(context, privateKey)) {
-        return nullptr;
+    connection->setServerConnectToken(device.getSct());
+    return connection;
+}
+
+// For a resolved future.
+static bool connectSucceeded(std::shared_ptr<nabto::client::FutureVoid> future)
+{
+    try {
+        future->getResult();
+    } catch (nabto::client::NabtoException& e) {
+        return false;
     }
-    connection->setPrivateKey(privateKey);
+    return true;
+}
 
+static std::shared_ptr<nabto::client::Connection> connectWithChannels(std::shared_ptr<nabto::client::Context> context, const Configuration::DeviceInfo& device, Configuration::ClientConfiguration& Config, const std::string& privateKey, ConnectStrategy& strategy, ConnectStrategy::Channels channels)
+{
+    auto connection = newConnection(context, device, Config, privateKey, strategy, channels);
 
-    if (!Config->getServerUrl().empty()) {
-        connection->setServerUrl(Config->getServerUrl());
+    auto candidates = strategy.rankCandidates(device);
+    if (!candidates.empty()) {
+        connection->enableDirectCandidates();
     }
 
-    connection->setServerConnectToken(device.getSct());
-
+    auto started = std::chrono::steady_clock::now();
+    size_t offered = 0;
     try {
-        connection->connect()->waitForResult();
+        auto future = connection->connect();
+        if (!candidates.empty()) {
+            // Offer the best candidate alone first, if it wins within
+            // the stagger we know exactly which candidate connected.
+            connection->addDirectCandidate(candidates[0].host_, candidates[0].port_);
+            offered = 1;
+            bool resolved = candidates.size() > 1 && future->waitFor(ConnectStrategy::candidateStaggerMs);
+            if (resolved && !connectSucceeded(future)) {
+                // The connect failed before the other candidates were
+                // offered, connect again with all of them such that a
+                // failure is a failure of every candidate.
+                connection = newConnection(context, device, Config, privateKey, strategy, channels);
+                connection->enableDirectCandidates();
+                future = connection->connect();
+                resolved = false;
+                offered = 0;
+            }
+            if (!resolved) {
+                for (size_t i = offered; i < candidates.size(); i++) {
+                    connection->addDirectCandidate(candidates[i].host_, candidates[i].port_);
+                }
+                offered = candidates.size();
+                connection->endOfDirectCandidates();
+            }
+        }
+        int timeoutMs = strategy.connectTimeoutMs(device, channels);
+        if (timeoutMs > 0) {
+            auto remaining = std::chrono::milliseconds(timeoutMs) - std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+            if (!future->waitFor((int)std::max<int64_t>(0, remaining.count()))) {
+                // Far slower than this device has ever been, give up such that a dead device fails fast.
+                std::cerr << "Connect timed out after " << timeoutMs << "ms" << std::endl;
+                connection->close();
+            }
+        }
+        future->waitForResult();
     } catch (nabto::client::NabtoException& e) {
+        if (offered > 0) {
+            strategy.recordDirectCandidates(device, std::vector<Configuration::DirectCandidate>(candidates.begin(), candidates.begin() + offered), false, false, std::chrono::milliseconds(0));
+        }
         if (e.status().getErrorCode() == nabto::client::Status::NO_CHANNELS) {
             auto localStatus = nabto::client::Status(connection->getLocalChannelErrorCode());
             auto remoteStatus = nabto::client::Status(connection->getRemoteChannelErrorCode());
-            std::cerr << "Not Connected." << std::endl;
+            std::cerr << "Not Connected using " << ConnectStrategy::channelsAsString(channels) << " channels." << std::endl;
             std::cerr << " The Local status is: " << localStatus.getDescription() << std::endl;
             std::cerr << " The Remote status is: " << remoteStatus.getDescription() << std::endl;
         } else {
@@ -171,8 +218,146 @@ std::shared_ptr<nabto::client::Connection> createConnection(std::shared_ptr<nabt
         return nullptr;
     }
 
+    if (offered > 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        nabto::client::Status directStatus(connection->getDirectCandidatesChannelErrorCode());
+        // another channel won while the candidates were still being tried, nothing learned.
+        if (directStatus.getErrorCode() != nabto::client::Status::OPERATION_IN_PROGRESS) {
+            strategy.recordDirectCandidates(device, std::vector<Configuration::DirectCandidate>(candidates.begin(), candidates.begin() + offered), directStatus.ok(), offered == 1, elapsed);
+        }
+    }
+    return connection;
+}
+
+/**
+ * Race a local only connection (including the direct candidates)
+ * against a remote only connection started hedgeStaggerMs later. The
+ * first connection to connect is returned and the other is closed, so
+ * the connect time is the fastest of the two instead of their sum.
+ */
+static std::shared_ptr<nabto::client::Connection> connectHedged(std::shared_ptr<nabto::client::Context> context, const Configuration::DeviceInfo& device, Configuration::ClientConfiguration& Config, const std::string& privateKey, ConnectStrategy& strategy, ConnectStrategy::Channels& winnerChannels)
+{
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable cond;
+        int pending = 0;
+        std::shared_ptr<nabto::client::Connection> winner;
+        ConnectStrategy::Channels winnerChannels = ConnectStrategy::Channels::ANY;
+    };
+    auto race = std::make_shared<Race>();
+
+    auto start = [race](std::shared_ptr<nabto::client::Connection> connection, ConnectStrategy::Channels channels) {
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->pending++;
+        }
+        auto future = connection->connect();
+        future->callback([race, connection, channels](nabto::client::Status status) {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                race->pending--;
+                if (status.ok() && !race->winner) {
+                    race->winner = connection;
+                    race->winnerChannels = channels;
+                }
+                race->cond.notify_all();
+            });
+        return future;
+    };
+    auto decided = [race]() { return race->winner || race->pending == 0; };
+
+    auto local = newConnection(context, device, Config, privateKey, strategy, ConnectStrategy::Channels::LOCAL_ONLY);
+    auto remote = newConnection(context, device, Config, privateKey, strategy, ConnectStrategy::Channels::REMOTE_ONLY);
+    auto candidates = strategy.rankCandidates(device);
+    if (!candidates.empty()) {
+        local->enableDirectCandidates();
+    }
+    auto localFuture = start(local, ConnectStrategy::Channels::LOCAL_ONLY);
+    for (auto& c : candidates) {
+        local->addDirectCandidate(c.host_, c.port_);
+    }
+    if (!candidates.empty()) {
+        local->endOfDirectCandidates();
+    }
+
+    bool remoteStarted = false;
+    {
+        std::unique_lock<std::mutex> lock(race->mutex);
+        race->cond.wait_for(lock, std::chrono::milliseconds(ConnectStrategy::hedgeStaggerMs), decided);
+        remoteStarted = !race->winner;
+    }
+    std::shared_ptr<nabto::client::FutureVoid> remoteFuture;
+    if (remoteStarted) {
+        remoteFuture = start(remote, ConnectStrategy::Channels::REMOTE_ONLY);
+    }
+
+    std::shared_ptr<nabto::client::Connection> winner;
+    {
+        std::unique_lock<std::mutex> lock(race->mutex);
+        race->cond.wait(lock, decided);
+        winner = race->winner;
+    }
+
+    // Stop the loser, its connect future resolves in the background.
+    if (winner != local) {
+        local->close();
+    }
+    if (remoteStarted && winner != remote) {
+        remote->close();
+    }
+    if (!winner) {
+        std::cerr << "Not Connected using hedged local and remote channels." << std::endl;
+        std::cerr << " The Local status is: " << nabto::client::Status(local->getLocalChannelErrorCode()).getDescription() << std::endl;
+        std::cerr << " The Remote status is: " << nabto::client::Status(remote->getRemoteChannelErrorCode()).getDescription() << std::endl;
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(race->mutex);
+        winnerChannels = race->winnerChannels;
+    }
+    return winner;
+}
+
+std::shared_ptr<nabto::client::Connection> createConnection(std::shared_ptr<nabto::client::Context> context, const Configuration::DeviceInfo& device, ConnectStrategy& strategy)
+{
+    auto Config = Configuration::GetConfigInfo();
+    if (!Config) {
+        printMissingClientConfig(Configuration::GetConfigFilePath());
+        return nullptr;
+    }
+
+    std::string privateKey;
+    if(!Configuration::GetPrivateKey(context, privateKey)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<nabto::client::Connection> connection;
+    const auto& profile = Config->getConnectionProfile(device.getProductId(), device.getDeviceId());
+    for (auto channels : ConnectStrategy::allowedChannels(strategy.plan(device, Config->getHedgedConnect()), profile)) {
+        auto started = std::chrono::steady_clock::now();
+        if (channels == ConnectStrategy::Channels::HEDGED) {
+            connection = connectHedged(context, device, *Config, privateKey, strategy, channels);
+        } else {
+            connection = connectWithChannels(context, device, *Config, privateKey, strategy, channels);
+        }
+        strategy.recordOutcome(device, channels, connection != nullptr, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started));
+        if (connection) {
+            if (channels == ConnectStrategy::Channels::ANY) {
+                // a hedged connect reports the channel set which won, an ANY connect tells through the channel error codes.
+                strategy.recordReachedChannels(device,
+                                               connection->getLocalChannelErrorCode() == nabto::client::Status::OK,
+                                               connection->getRemoteChannelErrorCode() == nabto::client::Status::OK);
+            }
+            break;
+        }
+    }
+    if (!connection) {
+        return nullptr;
+    }
+
     try {
-        if (connection->getDeviceFingerprint() != device.getDeviceFingerprint()) {
+        Configuration::Fingerprint fingerprint;
+        if (!Configuration::Fingerprint::fromHex(connection->getDeviceFingerprint(), fingerprint) ||
+            fingerprint != device.getDeviceFingerprint()) {
             handleFingerprintMismatch(connection, device);
             return nullptr;
         }
@@ -181,7 +366,11 @@ std::shared_ptr<nabto::client::Connection> createConnection(std::shared_ptr<nabt
         return nullptr;
     }
 
-    // we are paired if the connection has a user in the device
+    // we are paired if the connection has a user in the device, a
+    // recent verification of the same fingerprint saves the round trip.
+    if (strategy.isPairingVerified(device)) {
+        return connection;
+    }
     IAM::IAMError ec;
     std::unique_ptr<IAM::User> user;
     std::tie(ec, user) = IAM::get_me(connection);
@@ -190,53 +379,110 @@ std::shared_ptr<nabto::client::Connection> createConnection(std::shared_ptr<nabt
         std::cerr << "The client is not paired with device, do the pairing again" << std::endl;
         return nullptr;
     }
+    strategy.markPairingVerified(device);
     return connection;
 }
 
-static nlohmann::json get_service(std::shared_ptr<nabto::client::Connection> connection, const std::string& service);
-static void print_service(const nlohmann::json& service);
+class TunnelService {
+ public:
+    std::string id_;
+    std::string type_;
+    std::string host_;
+    uint16_t port_ = 0;
+    bool hasPort_ = false;
+};
+
+class TunnelServiceDecoder : public CborDecoder {
+ public:
+    typedef TunnelService Result;
+    bool decode(nabto::client::BufferView cbor, TunnelService& service)
+    {
+        service_ = &service;
+        return parse(cbor);
+    }
+ protected:
+    void onString(std::string& value)
+    {
+        if (at({"Id"})) {
+            service_->id_ = value;
+        } else if (at({"Type"})) {
+            service_->type_ = value;
+        } else if (at({"Host"})) {
+            service_->host_ = value;
+        }
+    }
+    void onUnsigned(uint64_t value)
+    {
+        if (at({"Port"}) && value <= UINT16_MAX) {
+            service_->port_ = static_cast<uint16_t>(value);
+            service_->hasPort_ = true;
+        }
+    }
+ private:
+    TunnelService* service_ = nullptr;
+};
 
-std::map<std::string, nlohmann::json> list_services(std::shared_ptr<nabto::client::Connection> connection)
-{   
-    std::map<std::string, nlohmann::json> services;
+static std::unique_ptr<TunnelService> decode_service(std::shared_ptr<nabto::client::Coap> coap, const std::string& service);
+static void print_service(const TunnelService& service);
+
+std::map<std::string, TunnelService> list_services(std::shared_ptr<nabto::client::Connection> connection)
+{
+    std::map<std::string, TunnelService> services;
     auto coap = connection->createCoap("GET", "/tcp-tunnels/services");
     coap->execute()->waitForResult();
     if (coap->getResponseStatusCode() == 205 &&
-        coap->getResponseContentFormat() == COAP_CONTENT_FORMAT_APPLICATION_CBOR)
+        coap->getResponseContentFormat() == IAM::CONTENT_FORMAT_APPLICATION_CBOR)
     {
-        auto cbor = coap->getResponsePayload();
-        auto data = json::from_cbor(cbor);
-        if (data.is_array()) {
-            std::cout << "Available services ..." << std::endl;
-            try {
-                for (auto s : data) {
-                    nlohmann::json test = get_service(connection, s);
-                    if (!test.is_null()) {
-                        services.insert({s.get<std::string>(), test});
-                    }
-                }
-            } catch(std::exception& e) {
-                std::cerr << "Failed to get services: " << e.what() << std::endl;
-                return {};
+        auto cbor = coap->getResponsePayloadView();
+        std::set<std::string> ids;
+        if (!CborStringSetDecoder().decode(cbor, ids)) {
+            std::cerr << "Failed to get services: the list of services could not be decoded" << std::endl;
+            return {};
+        }
+        std::cout << "Available services ..." << std::endl;
+        // the services are requested concurrently, one round trip instead of one per service.
+        std::vector<std::pair<std::string, std::shared_ptr<nabto::client::Coap> > > requests;
+        std::vector<std::shared_ptr<nabto::client::Future> > futures;
+        for (const auto& id : ids) {
+            auto request = connection->createCoap("GET", "/tcp-tunnels/services/" + id);
+            futures.push_back(request->execute());
+            requests.push_back(std::make_pair(id, request));
+        }
+        try {
+            nabto::client::Future::whenAll(futures)->waitForResult();
+        } catch (nabto::client::NabtoException& e) {
+            // a failed request only leaves out its service.
+        }
+        for (const auto& r : requests) {
+            auto service = decode_service(r.second, r.first);
+            if (service) {
+                services.insert({r.first, *service});
             }
         }
     }
-    return services;;
+    return services;
 }
 
-nlohmann::json get_service(std::shared_ptr<nabto::client::Connection> connection, const std::string& service)
+std::unique_ptr<TunnelService> decode_service(std::shared_ptr<nabto::client::Coap> coap, const std::string& service)
 {
-    auto coap = connection->createCoap("GET", "/tcp-tunnels/services/" + service);
-    coap->execute()->waitForResult();
-    if (coap->getResponseStatusCode() == 205 &&
-        coap->getResponseContentFormat() == COAP_CONTENT_FORMAT_APPLICATION_CBOR)
-    {
-        auto cbor = coap->getResponsePayload();
-        auto data = json::from_cbor(cbor);
-        print_service(data);
-        return data;
+    try {
+        if (coap->getResponseStatusCode() != 205 ||
+            coap->getResponseContentFormat() != IAM::CONTENT_FORMAT_APPLICATION_CBOR)
+        {
+            return nullptr;
+        }
+    } catch (nabto::client::NabtoException& e) {
+        std::cerr << "Failed to get the service " << service << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+    auto cbor = coap->getResponsePayloadView();
+    auto decoded = std::make_unique<TunnelService>();
+    if (!TunnelServiceDecoder().decode(cbor, *decoded)) {
+        std::cerr << "Failed to decode the service " << service << std::endl;
+        return nullptr;
     }
-    return nullptr;
+    print_service(*decoded);
+    return decoded;
 }
 
 std::string constant_width_string(std::string in) {
@@ -248,13 +494,9 @@ std::string constant_width_string(std::string in) {
     return in;
 }
 
-void print_service(const nlohmann::json& service)
+void print_service(const TunnelService& service)
 {
-    std::string id = service["Id"].get<std::string>();
-    std::string type = service["Type"].get<std::string>();
-    std::string host = service["Host"].get<std::string>();
-    uint16_t port = service["Port"].get<uint16_t>();
-    std::cout << "Service: " << constant_width_string(id) << " Type: " << constant_width_string(type) << " Host: " << host << "  Port: " << port << std::endl;
+    std::cout << "Service: " << constant_width_string(service.id_) << " Type: " << constant_width_string(service.type_) << " Host: " << service.host_ << "  Port: " << service.port_ << std::endl;
 }
 
 bool split_in_service_and_port(const std::string& in, std::string& service, uint16_t& port)
@@ -514,26 +756,46 @@ public:
     HttpServer(int port) : serverPort(port) {}
 
     int initialize() {
-        auto bookmarks = Configuration::PrintBookmarks();
+        bookmarks = Configuration::PrintBookmarks();
         ctx = nabto::client::Context::create();
+        discovery = nabto::examples::common::LocalDiscovery::create(ctx);
+        strategy = std::make_shared<ConnectStrategy>(discovery);
+        connectExecutor = nabto::client::Executor::createThreadPool(connectThreads);
+
+        int idleTimeout = Configuration::ClientConfiguration::DEFAULT_IDLE_CONNECTION_TIMEOUT;
+        auto Config = Configuration::GetConfigInfo();
+        if (Config) {
+            idleTimeout = Config->getIdleConnectionTimeout();
+        }
+        stats = ConnectionStats::create(std::chrono::milliseconds(ConnectionStats::defaultIntervalMs));
+        auto context = ctx;
+        auto connectStrategy = strategy;
+        auto connectionStats = stats;
+        connections = std::make_shared<ConnectionManager>([context, connectStrategy, connectionStats](const Configuration::DeviceInfo& device) {
+                auto connection = createConnection(context, device, *connectStrategy);
+                if (connection) {
+                    connectionStats->attach(device, connection);
+                }
+                return connection;
+            }, std::chrono::seconds(idleTimeout));
+
+        // the tunnel streams of a connection follow its channel, a change needs no action beyond the log.
+        stats->setChannelChangedHandler([](const Configuration::InternedString& productId, const Configuration::InternedString& deviceId, nabto::client::Connection::Type type) {
+                std::cout << "The connection to " << productId.str() << "." << deviceId.str() << " changed to a " << (type == nabto::client::Connection::Type::DIRECT ? "direct" : "relay") << " channel" << std::endl;
+            });
         initializeEndpoints();
 
-        if (bookmarks.empty()) {
+        if (bookmarks->empty()) {
             std::cerr << "No bookmarks found." << std::endl;
             return 1;
         }
 
         // Access the first bookmark (arbitrary choice)
-        auto firstBookmark = bookmarks.begin(); // Get the first element in the map
+        auto firstBookmark = bookmarks->begin(); // Get the first element in the map
         std::cout << "Connecting to device with ID: " << firstBookmark->first << std::endl;
 
-        auto device = Configuration::GetPairedDevice(firstBookmark->first);
-        if (!device) {
-            std::cerr << "Failed to retrieve device information for ID: " << firstBookmark->first << std::endl;
-            return 1;
-        }
-
-        connection = createConnection(ctx, *device);
+        std::atomic_store(&connectedDevice, firstBookmark->second);
+        connections->get(*firstBookmark->second);
         return 0;
     }
 
@@ -547,7 +809,8 @@ public:
         {
             std::cerr << e.what() << '\n';
         }
-        
+        // the candidate stats recorded since their last write.
+        strategy->writeCandidateStats();
     }
 
 private:
@@ -555,9 +818,17 @@ private:
     int serverPort;
     std::mutex strMutex;
     std::shared_ptr<nabto::client::Context> ctx;
-    std::map<int, Configuration::DeviceInfo> bookmarks;
-    std::shared_ptr<nabto::client::Connection> connection;
-    std::vector<std::shared_ptr<nabto::client::TcpTunnel>> tunnels;
+    // bookmarks and connectedDevice are replaced by the handler threads, they are accessed with atomic_load and atomic_store.
+    std::shared_ptr<const Configuration::BookmarkMap> bookmarks;
+    // the bookmark /connect opens tunnels to.
+    std::shared_ptr<const Configuration::DeviceInfo> connectedDevice;
+    std::shared_ptr<nabto::examples::common::LocalDiscovery> discovery;
+    std::shared_ptr<ConnectStrategy> strategy;
+    std::shared_ptr<ConnectionStats> stats;
+    std::shared_ptr<ConnectionManager> connections;
+    // runs the blocking connects of /devices, such that a large bookmark list does not start a thread per device.
+    std::shared_ptr<nabto::client::Executor> connectExecutor;
+    static const int connectThreads = 8;
 
     void initializeEndpoints() {
         server.Get("/devices", [this](const httplib::Request &req, httplib::Response &res) {
@@ -575,6 +846,40 @@ private:
         server.Get("/pair", [this](const httplib::Request &req, httplib::Response &res) {
             handlePairing(req, res);
         });
+
+        server.Get("/tags", [this](const httplib::Request &req, httplib::Response &res) {
+            handleTags(req, res);
+        });
+
+        server.Get("/candidates", [this](const httplib::Request &req, httplib::Response &res) {
+            handleCandidates(req, res);
+        });
+
+        server.Get("/local-devices", [this](const httplib::Request &req, httplib::Response &res) {
+            handleGetLocalDevices(req, res);
+        });
+
+        server.Get("/connections", [this](const httplib::Request &req, httplib::Response &res) {
+            handleGetConnections(req, res);
+        });
+    }
+
+    // The bookmark of the device=<id> parameter, product=<id> is needed if several products have the device id.
+    static std::shared_ptr<const Configuration::DeviceInfo> findDevice(const httplib::Request &req) {
+        auto index = Configuration::GetBookmarkIndex();
+        std::string deviceId = req.get_param_value("device");
+        if (req.has_param("product")) {
+            return index->find(req.get_param_value("product"), deviceId);
+        }
+        return index->findByDeviceId(deviceId);
+    }
+
+    static std::vector<std::string> getParamValues(const httplib::Request &req, const std::string& key) {
+        std::vector<std::string> values;
+        for (size_t i = 0; i < req.get_param_value_count(key); i++) {
+            values.push_back(req.get_param_value(key, i));
+        }
+        return values;
     }
 
 
@@ -586,40 +891,76 @@ private:
         res.set_content(str, "text/plain");
     }
 
+    // /devices?tag=<tag>&service=<service> selects the bookmarks having
+    // all the given tags and services. Filtered queries are answered
+    // from the cached device attributes unless refresh is given, in
+    // which case only the selected devices are contacted.
     void handleGetDevices(const httplib::Request &req, httplib::Response &res) {
         auto name = req.get_param_value("name");
-        bookmarks = Configuration::PrintBookmarks();
-        auto contex = nabto::client::Context::create();
+        auto tags = getParamValues(req, "tag");
+        auto services = getParamValues(req, "service");
+        auto index = Configuration::GetBookmarkIndex();
+        std::atomic_store(&bookmarks, index->getBookmarks());
+        auto devices = index->query(tags, services);
         std::string str;
+
+        if ((!tags.empty() || !services.empty()) && !req.has_param("refresh")) {
+            for (const auto& device : devices) {
+                str += device->getAttributes().getFriendlyName() + ":" + device->getDeviceId() + "\n";
+            }
+            res.set_content(str, "text/plain");
+            return;
+        }
+
         std::cout << "name" + name << std::endl;
-        auto connectToDevice = [&str, this, contex](const std::pair<int, Configuration::DeviceInfo>& bookmark) {
-            try {
-                auto d = Configuration::GetPairedDevice(bookmark.first);
-                auto c = createConnection(contex, *d);
-                if (c != nullptr) {
-                    IAM::IAMError ec;
-                    std::shared_ptr<IAM::PairingInfo> pi;
-                    std::tie(ec, pi) = IAM::get_pairing_info(c);
-
-                    if (pi) {
-                        std::string localStr = pi->getFriendlyName() + ":" + bookmark.second.deviceId_ + "\n";
+        // the connect strategy blocks, so the connects run on the bounded connect pool. The
+        // pairing info request of a device is chained to its connect and is then in flight
+        // without holding a thread.
+        std::vector<std::shared_ptr<IAM::PairingInfoFuture> > requests(devices.size());
+        std::vector<std::shared_ptr<nabto::client::Future> > pending;
+        for (size_t i = 0; i < devices.size(); i++) {
+            auto connected = std::make_shared<std::shared_ptr<nabto::client::Connection> >();
+            auto connect = nabto::client::PromiseVoid::create();
+            auto device = devices[i];
+            connectExecutor->post([this, &str, device, connected, connect]() {
+                    try {
+                        *connected = connections->get(*device);
+                    } catch (const std::exception& e) {
                         std::lock_guard<std::mutex> lock(strMutex);
-                        str += localStr;
+                        str += "Failed to open a tunnel to " + device->getDeviceId() + ": " + e.what() + "\n";
                     }
-                }
-            } catch (const std::exception& e) {
-                std::lock_guard<std::mutex> lock(strMutex);
-                str += "Failed to open a tunnel to " + bookmark.second.deviceId_ + ": " + e.what() + "\n";
+                    connect->resolve(nabto::client::Status(nabto::client::Status::OK));
+                });
+            pending.push_back(connect->getFuture()->then([&requests, i, connected](nabto::client::Status) -> std::shared_ptr<nabto::client::Future> {
+                    if (!*connected) {
+                        return nullptr;
+                    }
+                    requests[i] = IAM::get_pairing_info_async(*connected);
+                    return requests[i]->getFuture();
+                }));
+        }
+        nabto::client::Future::whenAll(pending)->waitForResult();
+
+        for (size_t i = 0; i < devices.size(); i++) {
+            if (!requests[i]) {
+                continue;
+            }
+            const auto& device = devices[i];
+            IAM::IAMError ec;
+            std::shared_ptr<IAM::PairingInfo> pi;
+            std::tie(ec, pi) = requests[i]->getResult();
+            if (ec.statusCode() == 403) {
+                strategy->invalidatePairing(*device);
             }
-        };
 
-        std::vector<std::future<void>> futures;
-        for (const auto& bookmark : bookmarks) {
-            futures.push_back(std::async(std::launch::async, connectToDevice, bookmark));
-        }
+            if (pi) {
+                Configuration::DeviceAttributes attributes = device->getAttributes();
+                attributes.friendlyName_ = pi->getFriendlyName();
+                attributes.appName_ = pi->getAppName();
+                Configuration::UpdateBookmarkAttributes(device->getIndex(), attributes);
 
-        for (auto& future : futures) {
-            future.get();
+                str += pi->getFriendlyName() + ":" + device->getDeviceId() + "\n";
+            }
         }
 
         res.set_content(str, "text/plain");
@@ -628,27 +969,32 @@ private:
 
     void handleGetServices(const httplib::Request &req, httplib::Response &res) {
         std::string name = req.get_param_value("device");
-        ctx = nabto::client::Context::create();
         std::string itemText;
         
         try {
-            for (const auto& pair : bookmarks) {
-                if (pair.second.deviceId_ == name) {
-                    std::cout << " " << pair.first << " " << pair.second.deviceId_;
-                    auto Device = Configuration::GetPairedDevice(pair.first);
-                    if (!Device) {
-                        std::cerr << "The bookmark does not exist" << std::endl;
-                        continue;
+            for (const auto& pair : *std::atomic_load(&bookmarks)) {
+                if (pair.second->getDeviceId() == name) {
+                    std::cout << " " << pair.first << " " << pair.second->getDeviceId();
+                    auto previous = std::atomic_exchange(&connectedDevice, pair.second);
+                    if (previous && previous != pair.second) {
+                        // the tunnels of the previous device no longer keep its connection open.
+                        connections->clearTunnels(*previous);
                     }
-                    connection = createConnection(ctx, *Device);
+                    auto connection = connections->get(*pair.second);
                     if (!connection) {
                         continue;
                     }
 
                     auto servs = list_services(connection);
-                    tunnels.clear();
+                    Configuration::DeviceAttributes attributes = pair.second->getAttributes();
+                    attributes.services_.clear();
+                    for (const auto& x : servs) {
+                        attributes.services_.push_back(Configuration::InternedString(x.first));
+                    }
+                    Configuration::UpdateBookmarkAttributes(pair.first, attributes);
+
                     for (const auto& x : servs) {
-                        itemText += x.first + ":" + (x.second.contains("Type") ? x.second["Type"].get<std::string>() : "Unknown") + ":" +(x.second.contains("Port") && x.second["Port"].is_number_integer() ? std::to_string(x.second["Port"].get<uint16_t>()) : "Unknown") + "\n";
+                        itemText += x.first + ":" + (x.second.type_.empty() ? "Unknown" : x.second.type_) + ":" + (x.second.hasPort_ ? std::to_string(x.second.port_) : "Unknown") + "\n";
                     }
                 }
             }
@@ -658,37 +1004,236 @@ private:
         res.set_content(itemText, "text/plain");
     }
 
+    // /tags?device=<id>[&product=<id>] lists the tags of a device, add=<tag> and remove=<tag> edits them.
+    void handleTags(const httplib::Request &req, httplib::Response &res) {
+        std::string name = req.get_param_value("device");
+        auto device = findDevice(req);
+        if (!device) {
+            res.status = 404;
+            res.set_content("Unknown device " + name + ", give product=<id> if several products have the device id\n", "text/plain");
+            return;
+        }
+        for (const auto& tag : getParamValues(req, "add")) {
+            Configuration::SetBookmarkTag(device->getIndex(), tag, true);
+        }
+        for (const auto& tag : getParamValues(req, "remove")) {
+            Configuration::SetBookmarkTag(device->getIndex(), tag, false);
+        }
+
+        // the bookmark may have been deleted meanwhile.
+        auto updated = Configuration::GetPairedDevice(device->getIndex());
+        if (!updated) {
+            res.status = 404;
+            res.set_content("Unknown device " + name + "\n", "text/plain");
+            return;
+        }
+        std::string str;
+        for (const auto& tag : updated->getTags()) {
+            str += tag.str() + "\n";
+        }
+        res.set_content(str, "text/plain");
+    }
+
+    // /candidates?device=<id>[&product=<id>] lists the direct candidates of a device, add=<host:port> and remove=<host:port> edits them.
+    void handleCandidates(const httplib::Request &req, httplib::Response &res) {
+        std::string name = req.get_param_value("device");
+        auto device = findDevice(req);
+        if (!device) {
+            res.status = 404;
+            res.set_content("Unknown device " + name + ", give product=<id> if several products have the device id\n", "text/plain");
+            return;
+        }
+        uint16_t defaultPort = Configuration::DirectCandidate::DEFAULT_PORT;
+        auto Config = Configuration::GetConfigInfo();
+        if (Config) {
+            defaultPort = Config->getConnectionProfile(device->getProductId(), device->getDeviceId()).directCandidatePort_;
+        }
+        std::vector<Configuration::DirectCandidate> added;
+        std::vector<Configuration::DirectCandidate> removed;
+        for (const auto& in : getParamValues(req, "add")) {
+            Configuration::DirectCandidate c;
+            if (!Configuration::DirectCandidate::parse(in, c, defaultPort)) {
+                res.status = 400;
+                res.set_content("Invalid candidate " + in + "\n", "text/plain");
+                return;
+            }
+            added.push_back(c);
+        }
+        for (const auto& in : getParamValues(req, "remove")) {
+            Configuration::DirectCandidate c;
+            if (Configuration::DirectCandidate::parse(in, c, defaultPort)) {
+                removed.push_back(c);
+            }
+        }
+        if (!added.empty() || !removed.empty()) {
+            // edited under the bookmark lock such that concurrent connects do not lose the edit, or the edit their stats.
+            Configuration::UpdateBookmarkDirectCandidates(device->getIndex(), [&added, &removed](std::vector<Configuration::DirectCandidate>& candidates) {
+                    bool changed = false;
+                    for (const auto& c : added) {
+                        auto it = std::find_if(candidates.begin(), candidates.end(), [&c](const Configuration::DirectCandidate& e) { return e.sameEndpoint(c); });
+                        if (it == candidates.end()) {
+                            candidates.push_back(c);
+                            changed = true;
+                        }
+                    }
+                    for (const auto& c : removed) {
+                        auto it = std::find_if(candidates.begin(), candidates.end(), [&c](const Configuration::DirectCandidate& e) { return e.sameEndpoint(c); });
+                        if (it != candidates.end()) {
+                            candidates.erase(it);
+                            changed = true;
+                        }
+                    }
+                    return changed;
+                });
+        }
+
+        auto updated = Configuration::GetPairedDevice(device->getIndex());
+        if (!updated) {
+            res.status = 404;
+            res.set_content("Unknown device " + name + "\n", "text/plain");
+            return;
+        }
+        std::string str;
+        for (const auto& c : strategy->rankCandidates(*updated)) {
+            str += c.toString() + " rtt: " + std::to_string(c.rttMs_) + "ms successes: " + std::to_string(c.successes_) + " failures: " + std::to_string(c.failures_) + "\n";
+        }
+        res.set_content(str, "text/plain");
+    }
+
+    void handleGetLocalDevices(const httplib::Request &req, httplib::Response &res) {
+        (void)req;
+        auto now = std::chrono::steady_clock::now();
+        json devices = json::array();
+        for (const auto& d : discovery->getDevices()) {
+            devices.push_back({
+                    {"ProductId", d.productId_},
+                    {"DeviceId", d.deviceId_},
+                    {"ServiceInstanceName", d.serviceInstanceName_},
+                    {"TxtItems", d.txtItems_},
+                    {"LastSeenMs", std::chrono::duration_cast<std::chrono::milliseconds>(now - d.lastSeen_).count()}
+                });
+        }
+        res.set_content(devices.dump(), "application/json");
+    }
+
+    static const char* eventAsString(int event) {
+        if (event == nabto::client::ConnectionEventsCallback::CONNECTED()) {
+            return "CONNECTED";
+        } else if (event == nabto::client::ConnectionEventsCallback::CLOSED()) {
+            return "CLOSED";
+        } else if (event == nabto::client::ConnectionEventsCallback::CHANNEL_CHANGED()) {
+            return "CHANNEL_CHANGED";
+        }
+        return "SAMPLE";
+    }
+
+    // /connections?device=<id> returns the sampled connection statistics of all or one device as json.
+    void handleGetConnections(const httplib::Request &req, httplib::Response &res) {
+        std::string name = req.get_param_value("device");
+        json devices = json::array();
+        for (const auto& series : stats->getSeries()) {
+            if (!name.empty() && series.deviceId_ != name) {
+                continue;
+            }
+            json samples = json::array();
+            for (const auto& s : series.samples_) {
+                json sample = {
+                    {"Time", std::chrono::duration_cast<std::chrono::milliseconds>(s.time_.time_since_epoch()).count()},
+                    {"Event", eventAsString(s.event_)},
+                    {"Connected", s.connected_}
+                };
+                if (s.connected_) {
+                    sample["Type"] = s.type_ == nabto::client::Connection::Type::DIRECT ? "DIRECT" : "RELAY";
+                    json info = json::parse(s.info_, nullptr, false);
+                    // a malformed info string would make the whole response invalid json.
+                    sample["Info"] = info.is_discarded() ? json(nullptr) : info;
+                    sample["LocalChannelError"] = nabto::client::Status(s.localChannelErrorCode_).getDescription();
+                    sample["RemoteChannelError"] = nabto::client::Status(s.remoteChannelErrorCode_).getDescription();
+                    sample["DirectCandidatesChannelError"] = nabto::client::Status(s.directCandidatesChannelErrorCode_).getDescription();
+                }
+                samples.push_back(sample);
+            }
+            devices.push_back({
+                    {"ProductId", series.productId_},
+                    {"DeviceId", series.deviceId_},
+                    {"RelayFallbacks", series.relayFallbacks_},
+                    {"Samples", samples}
+                });
+        }
+        res.set_content(devices.dump(), "application/json");
+    }
+
     void handleConnect(const httplib::Request &req, httplib::Response &res){
         std::string ser = req.get_param_value("service");
         std::vector<std::string> services;
         services.push_back(ser);
         std::cout << "Connecting to service: " << ser << std::endl;
-        std::string string_tcptunnel = tcptunnel(connection, services);
+        std::shared_ptr<nabto::client::Connection> connection;
+        auto device = std::atomic_load(&connectedDevice);
+        if (device) {
+            // reconnects if the connection was closed while idle.
+            connection = connections->get(*device);
+        }
+        if (!connection) {
+            res.set_content("Not connected to a device", "text/plain");
+            return;
+        }
+        std::string string_tcptunnel = tcptunnel(connection, *device, services);
         res.set_content(string_tcptunnel, "text/plain");
     }
 
-    std::string tcptunnel(std::shared_ptr<nabto::client::Connection> connection, std::vector<std::string> services)
-    {   
+    std::string tcptunnel(std::shared_ptr<nabto::client::Connection> connection, const Configuration::DeviceInfo& device, std::vector<std::string> services)
+    {
         std::string str="";
+        // the tunnels are opened concurrently and the results are checked in the order of the request.
+        std::vector<std::pair<std::string, std::string> > requested;
+        std::vector<std::shared_ptr<nabto::client::TcpTunnel> > tunnels;
+        std::vector<std::shared_ptr<nabto::client::FutureVoid> > opened;
+        std::vector<std::shared_ptr<nabto::client::Future> > futures;
         for (auto serviceAndPort : services) {
             std::string service;
             uint16_t localPort;
             if (!split_in_service_and_port(serviceAndPort, service, localPort)) {
-                return str;
+                break;
             }
-            
-            std::shared_ptr<nabto::client::TcpTunnel> tunnel;
             try {
-                tunnel = connection->createTcpTunnel();
+                auto tunnel = connection->createTcpTunnel();
                 std::cout << serviceAndPort << std::endl;
-                tunnel->open(service, localPort)->waitForResult();
+                auto future = tunnel->open(service, localPort);
+                opened.push_back(future);
+                futures.push_back(future);
                 tunnels.push_back(tunnel);
+                requested.push_back(std::make_pair(serviceAndPort, service));
+            } catch (std::exception& e) {
+                return "Failed to open a tunnel to " + serviceAndPort + " error: " + e.what();
+            }
+        }
+        try {
+            nabto::client::Future::whenAll(futures)->waitForResult();
+        } catch (nabto::client::NabtoException& e) {
+            // the failed tunnel is found below.
+        }
+
+        for (size_t i = 0; i < tunnels.size(); i++) {
+            const std::string& serviceAndPort = requested[i].first;
+            const std::string& service = requested[i].second;
+            try {
+                opened[i]->waitForResult();
+                connections->addTunnel(device, tunnels[i]);
+            } catch (nabto::client::NabtoException& e) {
+                if (e.status().getErrorCode() == nabto::client::Status::FORBIDDEN) {
+                    // maybe no longer paired, verify the pairing on the next connect.
+                    strategy->invalidatePairing(device);
+                } else if (e.status().getErrorCode() == nabto::client::Status::CLOSED || e.status().getErrorCode() == nabto::client::Status::NOT_CONNECTED) {
+                    // the device closed the connection, reconnect on the next request.
+                    connections->invalidate(device);
+                }
+                return "Failed to open a tunnel to " + serviceAndPort + " error: " + e.what();
             } catch (std::exception& e) {
                 return "Failed to open a tunnel to " + serviceAndPort + " error: " + e.what();
             }
 
-            str = service + ":" + std::to_string(tunnel->getLocalPort());
-            
+            str = service + ":" + std::to_string(tunnels[i]->getLocalPort());
         }
         return str;
     }
@@ -1,6 +1,7 @@
 #include "iam.hpp"
+#include "cbor_decoder.hpp"
+#include "coap_endpoint.hpp"
 #include <string>
-#include <sstream>
 #include <iostream>
 #include <set>
 #include <vector>
@@ -141,231 +142,383 @@ std::unique_ptr<User> User::create(const nlohmann::json& in)
     }
 }
 
-std::pair<IAMError, std::set<std::string> > get_users(std::shared_ptr<nabto::client::Connection> connection)
-{
-    try {
-        auto coap = connection->createCoap("GET", "/iam/users");
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if (responseCode == 205) {
-            auto cbor = coap->getResponsePayload();
-            std::set<std::string> users;
-            json user_list = json::from_cbor(cbor);
-            for (auto &user : user_list)
-            {
-                users.insert(user.get<std::string>());
+/**
+ * Decodes a user like from_json(json, User) does, without the DOM.
+ */
+class UserDecoder : public CborDecoder {
+ public:
+    typedef User Result;
+    bool decode(nabto::client::BufferView cbor, User& user)
+    {
+        user_ = &user;
+        if (!parse(cbor) || !hasUsername_) {
+            return false;
+        }
+        // the single Fingerprint is from devices which predate Fingerprints.
+        if (!hasFingerprints_ && !fingerprint_.empty()) {
+            Fingerprint fp;
+            fp.fingerprint_ = fingerprint_;
+            user.fingerprints_.push_back(fp);
+        }
+        return true;
+    }
+ protected:
+    void onString(std::string& value)
+    {
+        if (at({"Username"})) {
+            user_->username_ = value;
+            hasUsername_ = true;
+        } else if (at({"Sct"})) {
+            user_->sct_ = value;
+        } else if (at({"Role"})) {
+            user_->role_ = value;
+        } else if (at({"Fingerprint"})) {
+            fingerprint_ = value;
+        } else if (at({"Fingerprints", nullptr, "Fingerprint"})) {
+            current_.fingerprint_ = value;
+            hasCurrent_ = true;
+        } else if (at({"Fingerprints", nullptr, "Name"})) {
+            current_.name_ = value;
+        }
+    }
+    void onStartMap()
+    {
+        if (at({"Fingerprints", nullptr})) {
+            current_ = Fingerprint();
+            hasCurrent_ = false;
+        }
+    }
+    void onEndMap()
+    {
+        if (at({"Fingerprints", nullptr}) && hasCurrent_) {
+            user_->fingerprints_.push_back(current_);
+        }
+    }
+    void onStartArray()
+    {
+        if (at({"Fingerprints"})) {
+            hasFingerprints_ = true;
+        }
+    }
+ private:
+    User* user_ = nullptr;
+    bool hasUsername_ = false;
+    bool hasFingerprints_ = false;
+    std::string fingerprint_;
+    Fingerprint current_;
+    bool hasCurrent_ = false;
+};
+
+class PairingInfoDecoder : public CborDecoder {
+ public:
+    typedef PairingInfo Result;
+    bool decode(nabto::client::BufferView cbor, PairingInfo& pi)
+    {
+        pi_ = &pi;
+        return parse(cbor);
+    }
+ protected:
+    void onString(std::string& value)
+    {
+        if (at({"ProductId"})) {
+            pi_->productId_ = value;
+        } else if (at({"DeviceId"})) {
+            pi_->deviceId_ = value;
+        } else if (at({"AppName"})) {
+            pi_->appName_ = value;
+        } else if (at({"AppVersion"})) {
+            pi_->appVersion_ = value;
+        } else if (at({"NabtoVersion"})) {
+            pi_->nabtoVersion_ = value;
+        } else if (at({"FriendlyName"})) {
+            pi_->friendlyName_ = value;
+        } else if (at({"Modes", nullptr})) {
+            if (value == "LocalOpen") {
+                pi_->modes_.insert(PairingMode::LOCAL_OPEN);
+            } else if (value == "PasswordOpen") {
+                pi_->modes_.insert(PairingMode::PASSWORD_OPEN);
+            } else if (value == "PasswordInvite") {
+                pi_->modes_.insert(PairingMode::PASSWORD_INVITE);
+            } else if (value == "LocalInitial") {
+                pi_->modes_.insert(PairingMode::LOCAL_INITIAL);
             }
-            return std::make_pair(IAMError(), users);
         }
-        return std::make_pair(IAMError(coap), std::set<std::string>());
-    } catch (nabto::client::NabtoException& e) {
-        return std::make_pair(IAMError(e), std::set<std::string>());
     }
-}
-std::pair<IAMError, std::unique_ptr<User> > get_user_path(std::shared_ptr<nabto::client::Connection> connection, const std::string& path)
-{
-    try {
-        auto coap = connection->createCoap("GET", path);
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if (responseCode == 205) {
-            auto cbor = coap->getResponsePayload();
+ private:
+    PairingInfo* pi_ = nullptr;
+};
+
+class SettingsDecoder : public CborDecoder {
+ public:
+    typedef Settings Result;
+    bool decode(nabto::client::BufferView cbor, Settings& settings)
+    {
+        settings_ = &settings;
+        settings = Settings();
+        return parse(cbor);
+    }
+ protected:
+    void onBool(bool value)
+    {
+        if (at({"LocalOpenPairing"})) {
+            settings_->localOpenPairing_ = value;
+        } else if (at({"PasswordOpenPairing"})) {
+            settings_->passwordOpenPairing_ = value;
+        }
+    }
+    void onString(std::string& value)
+    {
+        if (at({"PasswordOpenSct"})) {
+            settings_->passwordOpenSct_ = value;
+        } else if (at({"PasswordOpenPassword"})) {
+            settings_->passwordOpenPassword_ = value;
+        }
+    }
+ private:
+    Settings* settings_ = nullptr;
+};
 
+class CreateUserRequest {
+ public:
+    std::string username_;
+};
 
-            json user = json::from_cbor(cbor);
-            auto decoded = User::create(user);
-            if (decoded != nullptr) {
-                return make_pair(IAMError(), std::move(decoded));
-            }
-        }
-        return std::make_pair(IAMError(coap), nullptr);
-    } catch (nabto::client::NabtoException& e) {
-        return std::make_pair(IAMError(e), nullptr);
+void encodeCbor(std::vector<uint8_t>& out, const CreateUserRequest& request)
+{
+    cborHead(out, 5, 1);
+    ::encodeCbor(out, std::string("Username"));
+    ::encodeCbor(out, request.username_);
+}
+
+/*
+ * The IAM endpoints of the device.
+ */
+typedef CoapEndpointTraits<205, COAP_ANY_CONTENT_FORMAT, true, CoapNoPayload, CborStringSetDecoder> GetStringSet;
+typedef CoapEndpointTraits<205, COAP_ANY_CONTENT_FORMAT, true, CoapNoPayload, UserDecoder> GetUserTraits;
+typedef CoapEndpointTraits<204, COAP_ANY_CONTENT_FORMAT, true, std::string, CoapNoResponseDecoder> PutString;
+typedef CoapEndpointTraits<204, COAP_ANY_CONTENT_FORMAT, true, bool, CoapNoResponseDecoder> PutBool;
+
+class GetUsersEndpoint : public GetStringSet {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/users"; }
+};
+
+class GetUserEndpoint : public GetUserTraits {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/users/{}"; }
+};
+
+class GetMeEndpoint : public GetUserTraits {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/me"; }
+};
+
+class GetRolesEndpoint : public GetStringSet {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/roles"; }
+};
+
+class SetRoleEndpoint : public PutString {
+ public:
+    static constexpr const char* method() { return "PUT"; }
+    static constexpr const char* path() { return "/iam/users/{}/role"; }
+};
+
+class SetPasswordEndpoint : public PutString {
+ public:
+    static constexpr const char* method() { return "PUT"; }
+    static constexpr const char* path() { return "/iam/users/{}/password"; }
+};
+
+class CreateUserEndpoint : public CoapEndpointTraits<201, COAP_ANY_CONTENT_FORMAT, false, CreateUserRequest, UserDecoder> {
+ public:
+    static constexpr const char* method() { return "POST"; }
+    static constexpr const char* path() { return "/iam/users"; }
+};
+
+class GetPairingInfoEndpoint : public CoapEndpointTraits<205, CONTENT_FORMAT_APPLICATION_CBOR, true, CoapNoPayload, PairingInfoDecoder> {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/pairing"; }
+};
+
+class SetPasswordOpenPairingEndpoint : public PutBool {
+ public:
+    static constexpr const char* method() { return "PUT"; }
+    static constexpr const char* path() { return "/iam/settings/password-open-pairing"; }
+};
+
+class SetLocalOpenPairingEndpoint : public PutBool {
+ public:
+    static constexpr const char* method() { return "PUT"; }
+    static constexpr const char* path() { return "/iam/settings/local-open-pairing"; }
+};
+
+class GetSettingsEndpoint : public CoapEndpointTraits<205, CONTENT_FORMAT_APPLICATION_CBOR, true, CoapNoPayload, SettingsDecoder> {
+ public:
+    static constexpr const char* method() { return "GET"; }
+    static constexpr const char* path() { return "/iam/settings"; }
+};
+
+class SetFriendlyNameEndpoint : public PutString {
+ public:
+    static constexpr const char* method() { return "PUT"; }
+    static constexpr const char* path() { return "/iam/device-info/friendly-name"; }
+};
+
+template<typename T>
+static IAMError iamError(const CoapResult<T>& result)
+{
+    if (result.ok()) {
+        return IAMError();
+    } else if (result.exception_) {
+        return IAMError(*result.exception_);
+    } else if (!result.decodeError_.empty()) {
+        return IAMError(result.decodeError_);
     }
+    return IAMError(result.coap_);
 }
-std::pair<IAMError, std::unique_ptr<User> > get_user(std::shared_ptr<nabto::client::Connection> connection, const std::string& username)
+
+template<typename T>
+static std::pair<IAMError, std::unique_ptr<T> > iamResult(CoapResult<T>& result)
 {
-    std::string path = "/iam/users/" + username;
-    return get_user_path(connection, path);
+    return std::make_pair(iamError(result), std::move(result.value_));
 }
 
-std::pair<IAMError, std::unique_ptr<User> > get_me(std::shared_ptr<nabto::client::Connection> connection)
+static std::pair<IAMError, std::set<std::string> > iamResult(CoapResult<std::set<std::string> >& result)
 {
-    return get_user_path(connection, "/iam/me");
+    return std::make_pair(iamError(result), result.ok() ? std::move(*result.value_) : std::set<std::string>());
 }
 
-std::pair<IAMError, std::set<std::string> > get_roles(
-    std::shared_ptr<nabto::client::Connection> connection)
+static void resolve(IAMErrorFuture& future, CoapResult<CoapNoResult>& result)
 {
-    auto coap = connection->createCoap("GET", "/iam/roles");
-    try {
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if (responseCode == 205) {
-            auto cbor = coap->getResponsePayload();
-            json role_list = json::from_cbor(cbor);
-            std::set<std::string> roles;
-            for (auto &role : role_list) {
-                roles.insert(role.get<std::string>());
-            }
-            return std::make_pair(IAMError(), roles);
-        }
-        return std::make_pair(IAMError(coap), std::set<std::string>());
-    } catch (nabto::client::NabtoException &e) {
-        return std::make_pair(IAMError(e), std::set<std::string>());
-    }
+    future.resolve(iamError(result));
 }
 
-IAMError set_role(std::shared_ptr<nabto::client::Connection> connection, const std::string &user, const std::string &role)
+template<typename T, typename R>
+static void resolve(IAMFuture<std::pair<IAMError, T> >& future, CoapResult<R>& result)
 {
-    std::stringstream path;
-    path << "/iam/users/" << user << "/role";
-    nlohmann::json root;
-    root = role;
-    std::vector<uint8_t> cbor = nlohmann::json::to_cbor(root);
+    future.resolve(iamResult(result));
+}
 
-    try {
-        auto coap = connection->createCoap("PUT", path.str());
-        coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cbor);
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if(responseCode == 204) {
-            return IAMError();
-        }
-        return IAMError(coap);
-    } catch (nabto::client::NabtoException& e) {
-        return IAMError(e);
-    }
+// Calls the endpoint and resolves the future with the result as the blocking functions return it.
+template<typename Endpoint, typename Future, typename... PathArgs>
+static std::shared_ptr<Future> callAsync(std::shared_ptr<nabto::client::Connection> connection, const typename Endpoint::RequestType& request, const PathArgs&... pathArgs)
+{
+    auto future = std::make_shared<Future>();
+    CoapEndpoint<Endpoint>::callAsync(connection, request, [future](CoapResult<typename CoapEndpoint<Endpoint>::Result>& result) {
+            resolve(*future, result);
+        }, pathArgs...);
+    return future;
 }
 
-IAMError set_password(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& password)
+std::shared_ptr<StringSetFuture> get_users_async(std::shared_ptr<nabto::client::Connection> connection)
 {
-    std::stringstream path;
-    path << "/iam/users/" << user << "/password";
-    try {
-        auto coap = connection->createCoap("PUT", path.str());
-        nlohmann::json root;
-        root = password;
-        std::vector<uint8_t> cbor = nlohmann::json::to_cbor(root);
-        coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cbor);
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if(responseCode == 204) {
-            return IAMError();
-        }
-        return IAMError(coap);
-    } catch (nabto::client::NabtoException& e) {
-        return IAMError(e);
-    }
+    return callAsync<GetUsersEndpoint, StringSetFuture>(connection, CoapNoPayload());
+}
 
+std::shared_ptr<UserFuture> get_user_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& username)
+{
+    return callAsync<GetUserEndpoint, UserFuture>(connection, CoapNoPayload(), username);
 }
 
-std::pair<IAMError, std::unique_ptr<User> > create_user(
-    std::shared_ptr<nabto::client::Connection> connection,
-    const std::string &username) {
-    auto coap = connection->createCoap("POST", "/iam/users");
-    nlohmann::json root;
-    root["Username"] = username;
-    std::vector<uint8_t> cborOut = nlohmann::json::to_cbor(root);
-    coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cborOut);
+std::shared_ptr<UserFuture> get_me_async(std::shared_ptr<nabto::client::Connection> connection)
+{
+    return callAsync<GetMeEndpoint, UserFuture>(connection, CoapNoPayload());
+}
 
-    coap->execute()->waitForResult();
-    uint16_t statusCode = coap->getResponseStatusCode();
-    if (statusCode == 201) {
-        auto cbor = coap->getResponsePayload();
+std::shared_ptr<StringSetFuture> get_roles_async(std::shared_ptr<nabto::client::Connection> connection)
+{
+    return callAsync<GetRolesEndpoint, StringSetFuture>(connection, CoapNoPayload());
+}
 
-        json user = json::from_cbor(cbor);
+std::shared_ptr<IAMErrorFuture> set_role_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& role)
+{
+    return callAsync<SetRoleEndpoint, IAMErrorFuture>(connection, role, user);
+}
 
-        std::unique_ptr<User> decoded = User::create(user);
-        return std::make_pair(IAMError(), std::move(decoded));
-    } else {
-        return std::make_pair(IAMError(coap), nullptr);
-    }
+std::shared_ptr<IAMErrorFuture> set_password_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& password)
+{
+    return callAsync<SetPasswordEndpoint, IAMErrorFuture>(connection, password, user);
 }
 
+std::shared_ptr<UserFuture> create_user_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& username)
+{
+    CreateUserRequest request;
+    request.username_ = username;
+    return callAsync<CreateUserEndpoint, UserFuture>(connection, request);
+}
 
-void from_json(const json& j, PairingInfo& pi)
+std::shared_ptr<PairingInfoFuture> get_pairing_info_async(std::shared_ptr<nabto::client::Connection> connection)
 {
-    try {
-        j.at("ProductId").get_to(pi.productId_);
-    } catch (std::exception& e) {}
+    return callAsync<GetPairingInfoEndpoint, PairingInfoFuture>(connection, CoapNoPayload());
+}
 
-    try {
-        j.at("DeviceId").get_to(pi.deviceId_);
-    } catch (std::exception& e) {}
+std::shared_ptr<IAMErrorFuture> set_settings_password_open_pairing_async(std::shared_ptr<nabto::client::Connection> connection, bool enabled)
+{
+    return callAsync<SetPasswordOpenPairingEndpoint, IAMErrorFuture>(connection, enabled);
+}
 
-    try {
-        j.at("AppName").get_to(pi.appName_);
-    } catch (std::exception& e) {}
+std::shared_ptr<IAMErrorFuture> set_settings_local_open_pairing_async(std::shared_ptr<nabto::client::Connection> connection, bool enabled)
+{
+    return callAsync<SetLocalOpenPairingEndpoint, IAMErrorFuture>(connection, enabled);
+}
 
-    try {
-        j.at("AppVersion").get_to(pi.appVersion_);
-    } catch (std::exception& e) {}
+std::shared_ptr<SettingsFuture> get_settings_async(std::shared_ptr<nabto::client::Connection> connection)
+{
+    return callAsync<GetSettingsEndpoint, SettingsFuture>(connection, CoapNoPayload());
+}
 
-    try {
-        j.at("NabtoVersion").get_to(pi.nabtoVersion_);
-    } catch (std::exception& e) {}
+std::shared_ptr<IAMErrorFuture> set_friendly_name_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& friendlyName)
+{
+    return callAsync<SetFriendlyNameEndpoint, IAMErrorFuture>(connection, friendlyName);
+}
 
-    try {
-        j.at("FriendlyName").get_to(pi.friendlyName_);
-    } catch (std::exception& e) {}
+std::pair<IAMError, std::set<std::string> > get_users(std::shared_ptr<nabto::client::Connection> connection)
+{
+    return get_users_async(connection)->waitForResult();
+}
 
-    try {
-        std::vector<std::string> modes = j["Modes"].get<std::vector<std::string> >();
-        for (auto m : modes) {
-            if (m == "LocalOpen") {
-                pi.modes_.insert(PairingMode::LOCAL_OPEN);
-            } else if (m == "PasswordOpen") {
-                pi.modes_.insert(PairingMode::PASSWORD_OPEN);
-            } else if (m == "PasswordInvite") {
-                pi.modes_.insert(PairingMode::PASSWORD_INVITE);
-            } else if (m == "LocalInitial") {
-                pi.modes_.insert(PairingMode::LOCAL_INITIAL);
-            }
-        }
-    } catch (std::exception& e) {}
+std::pair<IAMError, std::unique_ptr<User> > get_user(std::shared_ptr<nabto::client::Connection> connection, const std::string& username)
+{
+    return get_user_async(connection, username)->waitForResult();
 }
 
-void from_json(const json& j, Settings& s)
+std::pair<IAMError, std::unique_ptr<User> > get_me(std::shared_ptr<nabto::client::Connection> connection)
 {
-    try {
-        j.at("LocalOpenPairing").get_to(s.localOpenPairing_);
-    } catch (std::exception& e) {}
+    return get_me_async(connection)->waitForResult();
+}
 
-    try {
-        j.at("PasswordOpenPairing").get_to(s.passwordOpenPairing_);
-    } catch (std::exception& e) {}
+std::pair<IAMError, std::set<std::string> > get_roles(
+    std::shared_ptr<nabto::client::Connection> connection)
+{
+    return get_roles_async(connection)->waitForResult();
+}
 
-    try {
-        j.at("PasswordOpenSct").get_to(s.passwordOpenSct_);
-    } catch (std::exception& e) {}
+IAMError set_role(std::shared_ptr<nabto::client::Connection> connection, const std::string &user, const std::string &role)
+{
+    return set_role_async(connection, user, role)->waitForResult();
+}
+
+IAMError set_password(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& password)
+{
+    return set_password_async(connection, user, password)->waitForResult();
+}
 
-     try {
-        j.at("PasswordOpenPassword").get_to(s.passwordOpenPassword_);
-    } catch (std::exception& e) {}
+std::pair<IAMError, std::unique_ptr<User> > create_user(
+    std::shared_ptr<nabto::client::Connection> connection,
+    const std::string &username) {
+    return create_user_async(connection, username)->waitForResult();
 }
 
 std::pair<IAMError, std::unique_ptr<PairingInfo> > get_pairing_info(
     std::shared_ptr<nabto::client::Connection> connection)
 {
-    auto coap = connection->createCoap("GET", "/iam/pairing");
-    try {
-        coap->execute()->waitForResult();
-        int statusCode = coap->getResponseStatusCode();
-        int contentFormat = coap->getResponseContentFormat();
-        if (statusCode == 205 &&
-            contentFormat == CONTENT_FORMAT_APPLICATION_CBOR) {
-            std::vector<uint8_t> payload = coap->getResponsePayload();
-            nlohmann::json root = nlohmann::json::from_cbor(payload);
-            return std::make_pair(IAMError(), std::make_unique<PairingInfo>(root.get<PairingInfo>()));
-        }
-
-        return std::make_pair(IAMError(coap), nullptr);
-    } catch (nabto::client::NabtoException& e) {
-        return std::make_pair(IAMError(e), nullptr);
-    } catch (nlohmann::json::exception& e) {
-        return std::make_pair(IAMError(e), nullptr);
-    }
+    return get_pairing_info_async(connection)->waitForResult();
 }
 
 std::string pairingModeAsString(PairingMode mode)
@@ -385,85 +538,22 @@ std::string pairingModeAsString(PairingMode mode)
 
 IAMError set_settings_password_open_pairing(std::shared_ptr<nabto::client::Connection> connection, bool enabled)
 {
-    auto coap = connection->createCoap("PUT", "/iam/settings/password-open-pairing");
-    try {
-        nlohmann::json root;
-        root = enabled;
-        std::vector<uint8_t> cbor = nlohmann::json::to_cbor(root);
-        coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cbor);
-        coap->execute()->waitForResult();
-        int statusCode = coap->getResponseStatusCode();
-        if (statusCode == 204) {
-            return IAMError();
-        }
-        return IAMError(coap);
-    } catch (nabto::client::NabtoException& e) {
-        return IAMError(e);
-    }
+    return set_settings_password_open_pairing_async(connection, enabled)->waitForResult();
 }
 
 IAMError set_settings_local_open_pairing(std::shared_ptr<nabto::client::Connection> connection, bool enabled)
 {
-    auto coap = connection->createCoap("PUT", "/iam/settings/local-open-pairing");
-    try {
-        nlohmann::json root;
-        root = enabled;
-        std::vector<uint8_t> cbor = nlohmann::json::to_cbor(root);
-        coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cbor);
-        coap->execute()->waitForResult();
-        int statusCode = coap->getResponseStatusCode();
-        if (statusCode == 204) {
-            return IAMError();
-        }
-        return IAMError(coap);
-    } catch (nabto::client::NabtoException& e) {
-        return IAMError(e);
-    }
+    return set_settings_local_open_pairing_async(connection, enabled)->waitForResult();
 }
 
 std::pair<IAMError, std::unique_ptr<Settings> > get_settings(std::shared_ptr<nabto::client::Connection> connection)
 {
-    auto coap = connection->createCoap("GET", "/iam/settings");
-    try {
-        coap->execute()->waitForResult();
-        int statusCode = coap->getResponseStatusCode();
-        int contentFormat = coap->getResponseContentFormat();
-        if (statusCode == 205 &&
-            contentFormat == CONTENT_FORMAT_APPLICATION_CBOR) {
-            std::vector<uint8_t> payload = coap->getResponsePayload();
-            nlohmann::json root = nlohmann::json::from_cbor(payload);
-            return std::make_pair(IAMError(), std::make_unique<Settings>(root.get<Settings>()));
-        }
-
-        return std::make_pair(IAMError(coap), nullptr);
-    } catch (nabto::client::NabtoException& e) {
-        return std::make_pair(IAMError(e), nullptr);
-    } catch (nlohmann::json::exception& e) {
-        return std::make_pair(IAMError(e), nullptr);
-    }
+    return get_settings_async(connection)->waitForResult();
 }
 
 IAMError set_friendly_name(std::shared_ptr<nabto::client::Connection> connection, const std::string& friendlyName)
 {
-    std::string path = "/iam/device-info/friendly-name";
-    nlohmann::json root;
-    root = friendlyName;
-    std::vector<uint8_t> cbor = nlohmann::json::to_cbor(root);
-
-    try {
-        auto coap = connection->createCoap("PUT", path);
-        coap->setRequestPayload(CONTENT_FORMAT_APPLICATION_CBOR, cbor);
-        coap->execute()->waitForResult();
-        int responseCode = coap->getResponseStatusCode();
-        if(responseCode == 204) {
-            return IAMError();
-        }
-        return IAMError(coap);
-    } catch (nabto::client::NabtoException& e) {
-        return IAMError(e);
-    }
+    return set_friendly_name_async(connection, friendlyName)->waitForResult();
 }
 
-
-
 }
@@ -5,6 +5,7 @@
 #include <nabto/nabto_client_experimental.h>
 #include <string>
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -57,7 +58,7 @@ class User {
     std::vector<Fingerprint> fingerprints_;
 };
 
-const static int CONTENT_FORMAT_APPLICATION_CBOR = 60; // rfc 7059
+const static int CONTENT_FORMAT_APPLICATION_CBOR = 60; // rfc 7049
 
 enum class PairingMode {
     NONE,
@@ -100,6 +101,83 @@ class Settings {
     std::string passwordOpenPassword_;
 };
 
+/**
+ * The result of an asynchronous IAM request. The future resolves ok
+ * when the request is done, also if the request failed, such that it
+ * combines with whenAll and co_await without losing the IAM error which
+ * is part of the result. The result may hold a unique_ptr, so it is
+ * moved out and can be taken once.
+ */
+template<typename T>
+class IAMFuture {
+ public:
+    IAMFuture() : promise_(nabto::client::PromiseVoid::create()) {}
+
+    std::shared_ptr<nabto::client::FutureVoid> getFuture() { return promise_->getFuture(); }
+
+    // Waits for and takes the result, see getResult.
+    T waitForResult()
+    {
+        promise_->getFuture()->waitForResult();
+        return getResult();
+    }
+
+    // Takes the result, throws FUTURE_NOT_RESOLVED before the future resolves and INVALID_STATE if the result was taken already.
+    T getResult()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!resolved_) {
+            throw nabto::client::NabtoException(nabto::client::Status::FUTURE_NOT_RESOLVED);
+        }
+        if (taken_) {
+            throw nabto::client::NabtoException(nabto::client::Status::INVALID_STATE);
+        }
+        taken_ = true;
+        return std::move(result_);
+    }
+
+    void resolve(T result)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            result_ = std::move(result);
+            resolved_ = true;
+        }
+        promise_->resolve(nabto::client::Status(nabto::client::Status::OK));
+    }
+
+ private:
+    std::mutex mutex_;
+    T result_;
+    bool resolved_ = false;
+    bool taken_ = false;
+    std::shared_ptr<nabto::client::PromiseVoid> promise_;
+};
+
+typedef IAMFuture<IAMError> IAMErrorFuture;
+typedef IAMFuture<std::pair<IAMError, std::set<std::string> > > StringSetFuture;
+typedef IAMFuture<std::pair<IAMError, std::unique_ptr<User> > > UserFuture;
+typedef IAMFuture<std::pair<IAMError, std::unique_ptr<PairingInfo> > > PairingInfoFuture;
+typedef IAMFuture<std::pair<IAMError, std::unique_ptr<Settings> > > SettingsFuture;
+
+/*
+ * The asynchronous requests do not block the calling thread, many can
+ * be in flight on one thread. The blocking functions below wait for
+ * them.
+ */
+std::shared_ptr<StringSetFuture> get_users_async(std::shared_ptr<nabto::client::Connection> connection);
+std::shared_ptr<UserFuture> get_user_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& username);
+std::shared_ptr<StringSetFuture> get_roles_async(std::shared_ptr<nabto::client::Connection> connection);
+std::shared_ptr<IAMErrorFuture> set_role_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& role);
+std::shared_ptr<IAMErrorFuture> set_password_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& user, const std::string& password);
+std::shared_ptr<UserFuture> create_user_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& username);
+std::shared_ptr<UserFuture> get_me_async(std::shared_ptr<nabto::client::Connection> connection);
+std::shared_ptr<PairingInfoFuture> get_pairing_info_async(std::shared_ptr<nabto::client::Connection> connection);
+std::shared_ptr<IAMErrorFuture> set_settings_password_open_pairing_async(std::shared_ptr<nabto::client::Connection> connection, bool enabled);
+std::shared_ptr<IAMErrorFuture> set_settings_local_open_pairing_async(std::shared_ptr<nabto::client::Connection> connection, bool enabled);
+std::shared_ptr<SettingsFuture> get_settings_async(std::shared_ptr<nabto::client::Connection> connection);
+std::shared_ptr<IAMErrorFuture> set_friendly_name_async(std::shared_ptr<nabto::client::Connection> connection, const std::string& friendlyName);
+
 std::pair<IAMError, std::unique_ptr<PairingInfo> > get_pairing_info(std::shared_ptr<nabto::client::Connection> connection);
 std::pair<IAMError, std::set<std::string> > get_users(std::shared_ptr<nabto::client::Connection> connection);
 std::pair<IAMError, std::unique_ptr<User> > get_user(std::shared_ptr<nabto::client::Connection> connection, const std::string& username);
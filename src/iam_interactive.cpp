@@ -83,9 +83,9 @@ bool list_users(std::shared_ptr<nabto::client::Connection> connection)
         {
             case 205:
             {
-                auto cbor = coap->getResponsePayload();
+                auto cbor = coap->getResponsePayloadView();
                 std::cout << "Listing all users on the device ..." << std::endl;
-                nlohmann::json user_list = nlohmann::json::from_cbor(cbor);
+                nlohmann::json user_list = nlohmann::json::from_cbor(cbor.begin(), cbor.end());
                 int i = 1;
                 for (auto &user : user_list)
                 {
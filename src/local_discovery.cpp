@@ -0,0 +1,120 @@
+#include "local_discovery.hpp"
+
+#include <3rdparty/nlohmann/json.hpp>
+
+#include <iostream>
+
+namespace nabto {
+namespace examples {
+namespace common {
+
+std::shared_ptr<LocalDiscovery> LocalDiscovery::create(std::shared_ptr<nabto::client::Context> ctx, const std::string& subtype)
+{
+    auto discovery = std::make_shared<LocalDiscovery>(ctx, subtype);
+    discovery->listen();
+    return discovery;
+}
+
+LocalDiscovery::LocalDiscovery(std::shared_ptr<nabto::client::Context> ctx, const std::string& subtype)
+    : ctx_(ctx), resolver_(ctx->createMdnsResolver(subtype))
+{
+}
+
+LocalDiscovery::~LocalDiscovery()
+{
+    stop();
+}
+
+void LocalDiscovery::stop()
+{
+    resolver_->stop();
+}
+
+std::vector<LocalDevice> LocalDiscovery::getDevices()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<LocalDevice> devices;
+    for (auto& d : devices_) {
+        devices.push_back(d.second);
+    }
+    return devices;
+}
+
+bool LocalDiscovery::lookup(const std::string& productId, const std::string& deviceId, LocalDevice& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = devices_.find(std::make_pair(productId, deviceId));
+    if (it == devices_.end()) {
+        return false;
+    }
+    device = it->second;
+    return true;
+}
+
+void LocalDiscovery::listen()
+{
+    std::weak_ptr<LocalDiscovery> weak = shared_from_this();
+    auto future = resolver_->getResult();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = future;
+    }
+    future->callback([weak](nabto::client::Status status) {
+            auto self = weak.lock();
+            if (self) {
+                self->resolved(status);
+            }
+        });
+}
+
+void LocalDiscovery::resolved(nabto::client::Status status)
+{
+    std::shared_ptr<nabto::client::FutureMdnsResult> future;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        future.swap(pending_);
+    }
+    if (!status.ok() || !future) {
+        // The resolver is stopped.
+        return;
+    }
+    try {
+        handleResult(future->getResult());
+    } catch (std::exception& e) {
+        std::cerr << "Invalid mDNS result: " << e.what() << std::endl;
+    }
+    listen();
+}
+
+void LocalDiscovery::handleResult(std::shared_ptr<nabto::client::MdnsResult> result)
+{
+    auto key = std::make_pair(result->getProductId(), result->getDeviceId());
+    if (key.first.empty() || key.second.empty()) {
+        return;
+    }
+
+    if (result->getAction() == nabto::client::MdnsResult::Action::REMOVE) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        devices_.erase(key);
+        return;
+    }
+
+    LocalDevice device;
+    device.productId_ = key.first;
+    device.deviceId_ = key.second;
+    device.serviceInstanceName_ = result->getServiceInstanceName();
+    device.lastSeen_ = std::chrono::steady_clock::now();
+    nlohmann::json txtItems = nlohmann::json::parse(result->getTxtItems(), nullptr, false);
+    if (txtItems.is_object()) {
+        for (auto& item : txtItems.items()) {
+            if (item.value().is_string()) {
+                device.txtItems_[item.key()] = item.value().get<std::string>();
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    devices_[key] = device;
+}
+
+} } } // namespace
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <nabto_client.hpp>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace examples {
+namespace common {
+
+class LocalDevice {
+ public:
+    std::string productId_;
+    std::string deviceId_;
+    std::string serviceInstanceName_;
+    std::map<std::string, std::string> txtItems_;
+    std::chrono::steady_clock::time_point lastSeen_;
+};
+
+/**
+ * Resident mDNS discovery. A single long lived resolver keeps a table
+ * of the devices which currently announce themselves on the local
+ * network. The table follows the ADD/UPDATE/REMOVE actions of the
+ * resolver, so lookups are answered instantly instead of waiting for
+ * a scan.
+ */
+class LocalDiscovery : public std::enable_shared_from_this<LocalDiscovery> {
+ public:
+    static std::shared_ptr<LocalDiscovery> create(std::shared_ptr<nabto::client::Context> ctx, const std::string& subtype = "");
+
+    LocalDiscovery(std::shared_ptr<nabto::client::Context> ctx, const std::string& subtype);
+    ~LocalDiscovery();
+
+    void stop();
+
+    std::vector<LocalDevice> getDevices();
+
+    // returns true and fills in device if the device is currently visible on the local network.
+    bool lookup(const std::string& productId, const std::string& deviceId, LocalDevice& device);
+
+ private:
+    void listen();
+    void resolved(nabto::client::Status status);
+    void handleResult(std::shared_ptr<nabto::client::MdnsResult> result);
+
+    std::shared_ptr<nabto::client::Context> ctx_;
+    std::shared_ptr<nabto::client::MdnsResolver> resolver_;
+    std::shared_ptr<nabto::client::FutureMdnsResult> pending_;
+    std::mutex mutex_;
+    std::map<std::pair<std::string, std::string>, LocalDevice> devices_;
+};
+
+} } } // namespace
@@ -4,6 +4,7 @@
 #include "scanner.hpp"
 #include "iam.hpp"
 #include "iam_interactive.hpp"
+#include "connect_strategy.hpp"
 
 #include <3rdparty/nlohmann/json.hpp>
 #include <iostream>
@@ -37,8 +38,8 @@ static bool local_pair_open_interactive(std::shared_ptr<nabto::client::Connectio
     coap->execute()->waitForResult();
     if (coap->getResponseStatusCode() != 201) {
         std::string reason;
-        auto buffer = coap->getResponsePayload();
-        reason = std::string(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        auto buffer = coap->getResponsePayloadView();
+        reason = std::string(reinterpret_cast<const char*>(buffer.data()), buffer.size());
         std::cout << "Could not pair with the device status: " << coap->getResponseStatusCode() << " " << reason << std::endl;
         return false;
     }
@@ -51,8 +52,8 @@ static bool local_pair_initial(std::shared_ptr<nabto::client::Connection> connec
     coap->execute()->waitForResult();
     if (coap->getResponseStatusCode() != 201) {
         std::string reason;
-        auto buffer = coap->getResponsePayload();
-        reason = std::string(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        auto buffer = coap->getResponsePayloadView();
+        reason = std::string(reinterpret_cast<const char*>(buffer.data()), buffer.size());
         std::cout << "Could not pair with the device status: " << coap->getResponseStatusCode() << " " << reason << std::endl;
         return false;
     }
@@ -76,8 +77,8 @@ static bool password_pair_password(std::shared_ptr<nabto::client::Connection> co
     coap->execute()->waitForResult();
     if (coap->getResponseStatusCode() != 201) {
         std::string reason;
-        auto buffer = coap->getResponsePayload();
-        reason = std::string(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        auto buffer = coap->getResponsePayloadView();
+        reason = std::string(reinterpret_cast<const char*>(buffer.data()), buffer.size());
         std::cout << "Could not pair with the device status: " << coap->getResponseStatusCode() << " " << reason << std::endl;
         return false;
     }
@@ -115,8 +116,8 @@ static bool password_invite_pair_password(std::shared_ptr<nabto::client::Connect
     coap->execute()->waitForResult();
     if (coap->getResponseStatusCode() != 201) {
         std::string reason;
-        auto buffer = coap->getResponsePayload();
-        reason = std::string(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        auto buffer = coap->getResponsePayloadView();
+        reason = std::string(reinterpret_cast<const char*>(buffer.data()), buffer.size());
         std::cout << "Could not pair with the device status: " << coap->getResponseStatusCode() << " " << reason << std::endl;
         return false;
     }
@@ -147,8 +148,16 @@ static bool password_invite_pair(std::shared_ptr<nabto::client::Connection> conn
 
 std::string interactive_pair(std::shared_ptr<nabto::client::Context> Context)
 {
-    std::cout << "Scanning for local devices for 2 seconds." << std::endl;
-    auto devices = nabto::examples::common::Scanner::scan(Context, std::chrono::milliseconds(2000), "tcptunnel");
+    std::cout << "Scanning for local devices for at most 2 seconds." << std::endl;
+    // Devices answer the mDNS query at about the same time, so the scan
+    // ends shortly after the last device has answered.
+    std::vector<std::tuple<std::string, std::string, std::string> > devices;
+    nabto::examples::common::Scanner::scan(Context, std::chrono::milliseconds(2000), "tcptunnel",
+        [&devices](const std::string& productId, const std::string& deviceId, const std::string& fn) {
+            std::cout << "[" << devices.size() << "]: ProductId: " << productId << " DeviceId: " << deviceId << " Name: " << fn << std::endl;
+            devices.push_back(std::make_tuple(productId, deviceId, fn));
+            return true;
+        }, std::chrono::milliseconds(300));
     if (devices.size() == 0) {
         return "Did not find any local devices, is the device on the same local network as the client?";
     }
@@ -157,14 +166,6 @@ std::string interactive_pair(std::shared_ptr<nabto::client::Context> Context)
     std::cout << "Choose a device for pairing:" << std::endl;
     std::cout << "[q]: Quit without pairing" << std::endl;
 
-    for (size_t i = 0; i < devices.size(); ++i) {
-        std::string ProductID;
-        std::string DeviceID;
-        std::string fn;
-        std::tie(ProductID, DeviceID, fn) = devices[i];
-        std::cout << "[" << i << "]: ProductId: " << ProductID << " DeviceId: " << DeviceID << " Name: " << fn << std::endl;
-    }
-
     int deviceChoice = IAM::interactive_choice("Choose a device: ", 0, devices.size());
     if (deviceChoice == -1) {
         return "Error";
@@ -185,9 +186,7 @@ std::string interactive_pair(std::shared_ptr<nabto::client::Context> Context)
         }
         connection->setPrivateKey(PrivateKey);
 
-        json options;
-        options["Remote"] = false;
-        connection->setOptions(options.dump());
+        connection->setOptions(ConnectStrategy::options(true, false));
 
         try {
             connection->connect()->waitForResult();
@@ -339,7 +338,7 @@ std::string param_pair(std::shared_ptr<nabto::client::Context> ctx, const std::s
     }
 
     connection->setServerConnectToken(sct);
-    json options;
+    connection->setOptions(Config->getConnectionProfile(productId, deviceId).options_);
 
     try {
         connection->connect()->waitForResult();
@@ -364,6 +363,17 @@ std::string param_pair(std::shared_ptr<nabto::client::Context> ctx, const std::s
 
 std::string direct_pair(std::shared_ptr<nabto::client::Context> Context, const std::string& host)
 {
+    auto Config = Configuration::GetConfigInfo();
+    if (!Config) {
+        return "Error";
+    }
+
+    Configuration::DirectCandidate candidate;
+    if (!Configuration::DirectCandidate::parse(host, candidate, Config->getDefaultProfile().directCandidatePort_)) {
+        std::cerr << "Invalid host " << host << std::endl;
+        return "Invalid host";
+    }
+
     auto connection = Context->createConnection();
     std::string privateKey;
 
@@ -371,20 +381,16 @@ std::string direct_pair(std::shared_ptr<nabto::client::Context> Context, const s
         return "Error";
     }
 
-    uint16_t port = 5592;
-
     connection->setPrivateKey(privateKey);
     connection->enableDirectCandidates();
-    connection->addDirectCandidate(host, port);
+    connection->addDirectCandidate(candidate.host_, candidate.port_);
     connection->endOfDirectCandidates();
 
-    json options;
+    // the keep alive and timeout options of the default profile still apply to a direct connection.
+    json options = json::parse(Config->getDefaultProfile().options_);
     options["Local"] = false;
     options["Remote"] = false;
-
-    std::stringstream o;
-    o << options;
-    connection->setOptions(o.str());
+    connection->setOptions(options.dump());
 
     try {
         connection->connect()->waitForResult();
@@ -416,12 +422,17 @@ std::string write_config(std::shared_ptr<nabto::client::Connection> connection,
         return "CoAP GET /iam/pairing failed, pairing failed";
     }
 
-    device.productId_ = pi->getProductId();
-    device.deviceId_ = pi->getDeviceId();
-    device.deviceFingerprint_ = connection->getDeviceFingerprint();
-    if (!host.empty()) {
-        device.directCandidate_ = host;
+    device.productId_ = Configuration::InternedString(pi->getProductId());
+    device.deviceId_ = Configuration::InternedString(pi->getDeviceId());
+    if (!Configuration::Fingerprint::fromHex(connection->getDeviceFingerprint(), device.deviceFingerprint_)) {
+        return "The device fingerprint is not valid, pairing failed";
+    }
+    Configuration::DirectCandidate candidate;
+    if (!host.empty() && Configuration::DirectCandidate::parse(host, candidate)) {
+        device.directCandidates_.push_back(candidate);
     }
+    device.attributes_.friendlyName_ = pi->getFriendlyName();
+    device.attributes_.appName_ = pi->getAppName();
 
     std::unique_ptr<IAM::User> user;
     std::tie(ec, user) = IAM::get_me(connection);
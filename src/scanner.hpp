@@ -5,7 +5,7 @@
 
 #include <vector>
 #include <chrono>
-#include <thread>
+#include <functional>
 #include <memory>
 #include <set>
 #include <iostream>
@@ -13,40 +13,124 @@ namespace nabto {
 namespace examples {
 namespace common {
 
+/**
+ * The end of a scan, the overall timeout or idleTimeout after the last
+ * new device, whichever comes first. The idle deadline only starts with
+ * the first device. An idleTimeout of zero only uses the overall
+ * timeout.
+ */
+class ScanDeadline {
+ public:
+    typedef std::chrono::steady_clock clock;
+
+    ScanDeadline(clock::time_point start, std::chrono::milliseconds timeout, std::chrono::milliseconds idleTimeout)
+        : overall_(start + timeout), idleTimeout_(idleTimeout)
+    {
+    }
+
+    void deviceFound(clock::time_point now)
+    {
+        if (idleTimeout_.count() > 0) {
+            idleDeadline_ = now + idleTimeout_;
+            idle_ = true;
+        }
+    }
+
+    clock::time_point get() const
+    {
+        if (idle_ && idleDeadline_ < overall_) {
+            return idleDeadline_;
+        }
+        return overall_;
+    }
+
+ private:
+    clock::time_point overall_;
+    std::chrono::milliseconds idleTimeout_;
+    clock::time_point idleDeadline_;
+    bool idle_ = false;
+};
+
 class Scanner {
  public:
-    static std::vector<std::tuple<std::string,std::string,std::string> > scan(std::shared_ptr<nabto::client::Context> ctx, std::chrono::milliseconds timeout, std::string subtype = "") {
+    /**
+     * Called with (productId, deviceId, friendlyName) as soon as a
+     * device is discovered. Return false to stop the scan.
+     */
+    typedef std::function<bool (const std::string&, const std::string&, const std::string&)> ScanCallback;
+
+    /**
+     * Scan for at most timeout and deliver each device once as it is
+     * discovered. If idleTimeout is nonzero the scan also ends when
+     * no new device has been found for idleTimeout, counted from the
+     * last new device. Returns true if the scan was stopped by the
+     * callback.
+     */
+    static bool scan(std::shared_ptr<nabto::client::Context> ctx, std::chrono::milliseconds timeout, const std::string& subtype, ScanCallback onDevice, std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(0))
+    {
+        typedef std::chrono::steady_clock clock;
+        ScanDeadline deadline(clock::now(), timeout, idleTimeout);
+        bool stoppedByCallback = false;
 
-        // We put the found devices into a set such that we can remove ipv4/ipv6 duplicates.
-        std::set<std::tuple<std::string, std::string, std::string> > localDevices;
+        // Devices are reported once per address, remember what has been delivered to remove ipv4/ipv6 duplicates.
+        std::set<std::pair<std::string, std::string> > seen;
         auto mdnsResolver = ctx->createMdnsResolver(subtype);
+        std::shared_ptr<nabto::client::FutureMdnsResult> next;
+        bool pending = false;
 
-        std::thread t([mdnsResolver, timeout]() { std::this_thread::sleep_for(timeout); mdnsResolver->stop(); });
-
-        try {
-            for (;;) {
-                auto next = mdnsResolver->getResult();
-                auto result = next->waitForResult();
-                std::string productId = result->getProductId();
-                std::string deviceId = result->getDeviceId();
-                std::string txtItemsStr = result->getTxtItems();
-                nlohmann::json txtItems = nlohmann::json::parse(txtItemsStr);
-                std::string fn;
-                try {
-                    fn = txtItems["fn"].get<std::string>();
-                } catch (std::exception& e) { }
-                localDevices.insert(std::make_tuple(productId, deviceId, fn));
+        for (;;) {
+            auto now = clock::now();
+            if (now >= deadline.get()) {
+                break;
+            }
+            next = mdnsResolver->getResult();
+            pending = true;
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.get() - now);
+            if (!next->waitFor((int)remaining.count())) {
+                break;
             }
-        } catch (...) {
+            pending = false;
 
+            std::shared_ptr<nabto::client::MdnsResult> result;
+            try {
+                result = next->getResult();
+            } catch (nabto::client::NabtoException& e) {
+                break;
+            }
+            if (result->getAction() == nabto::client::MdnsResult::Action::REMOVE) {
+                continue;
+            }
+            std::string productId = result->getProductId();
+            std::string deviceId = result->getDeviceId();
+            if (!seen.insert(std::make_pair(productId, deviceId)).second) {
+                continue;
+            }
+            deadline.deviceFound(clock::now());
+            std::string fn;
+            nlohmann::json txtItems = nlohmann::json::parse(result->getTxtItems(), nullptr, false);
+            if (txtItems.is_object() && txtItems.contains("fn") && txtItems["fn"].is_string()) {
+                fn = txtItems["fn"].get<std::string>();
+            }
+            if (!onDevice(productId, deviceId, fn)) {
+                stoppedByCallback = true;
+                break;
+            }
         }
 
-        t.join();
+        mdnsResolver->stop();
+        if (pending) {
+            // The stop resolves the outstanding future, wait for it such that the resolver can be freed.
+            next->waitFor(1000);
+        }
+        return stoppedByCallback;
+    }
 
+    static std::vector<std::tuple<std::string,std::string,std::string> > scan(std::shared_ptr<nabto::client::Context> ctx, std::chrono::milliseconds timeout, std::string subtype = "") {
         std::vector<std::tuple<std::string, std::string, std::string> > ret;
-        for (auto d : localDevices) {
-            ret.push_back(d);
-        }
+        scan(ctx, timeout, subtype, [&ret](const std::string& productId, const std::string& deviceId, const std::string& fn) {
+                ret.push_back(std::make_tuple(productId, deviceId, fn));
+                return true;
+            });
         return ret;
     }
 };
@@ -0,0 +1,5 @@
+#include "version.hpp"
+
+static const char* version_str = "1.0.0-master.50+f18ef7d.dirty"
+;
+const char* edge_tunnel_client_version() { return version_str; }
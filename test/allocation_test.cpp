@@ -0,0 +1,76 @@
+#include "test.hpp"
+
+#include <nabto_client.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts the heap allocations of the whole test executable.
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+using nabto::client::PromiseVoid;
+using nabto::client::Status;
+
+static void callbackBeforeResolve(int& calls)
+{
+    auto promise = PromiseVoid::create();
+    auto future = promise->getFuture();
+    future->onResult([&calls](Status status) { calls += status.ok() ? 1 : 0; }, nullptr);
+    promise->resolve(Status(Status::OK));
+}
+
+static void callbackAfterResolve(int& calls)
+{
+    auto promise = PromiseVoid::create();
+    promise->resolve(Status(Status::OK));
+    promise->getFuture()->onResult([&calls](Status status) { calls += status.ok() ? 1 : 0; }, nullptr);
+}
+
+TEST_CASE(resolvingAFutureAllocatesNothingAfterWarmup)
+{
+    int calls = 0;
+    for (int i = 0; i < 10; i++) {
+        callbackBeforeResolve(calls);
+    }
+    size_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+        callbackBeforeResolve(calls);
+    }
+    CHECK(allocations == before);
+    CHECK(calls == 1010);
+}
+
+TEST_CASE(callbackOnAResolvedFutureAllocatesNothingAfterWarmup)
+{
+    int calls = 0;
+    for (int i = 0; i < 10; i++) {
+        callbackAfterResolve(calls);
+    }
+    size_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+        callbackAfterResolve(calls);
+    }
+    CHECK(allocations == before);
+    CHECK(calls == 1010);
+}
@@ -0,0 +1,121 @@
+#include "test.hpp"
+
+#include <src/cbor_decoder.hpp>
+
+using json = nlohmann::json;
+using nabto::client::BufferView;
+
+namespace {
+
+class FingerprintDecoder : public CborDecoder {
+ public:
+    bool decode(BufferView cbor)
+    {
+        return parse(cbor);
+    }
+    std::string username_;
+    std::vector<std::string> fingerprints_;
+    uint64_t count_ = 0;
+    bool admin_ = false;
+    int maps_ = 0;
+ protected:
+    void onString(std::string& value)
+    {
+        if (at({"Username"})) {
+            username_ = value;
+        } else if (at({"Fingerprints", nullptr, "Fingerprint"})) {
+            fingerprints_.push_back(value);
+        }
+    }
+    void onUnsigned(uint64_t value)
+    {
+        if (at({"Count"})) {
+            count_ = value;
+        }
+    }
+    void onBool(bool value)
+    {
+        if (at({"Admin"})) {
+            admin_ = value;
+        }
+    }
+    void onStartMap()
+    {
+        if (at({"Fingerprints", nullptr})) {
+            maps_++;
+        }
+    }
+};
+
+} // namespace
+
+TEST_CASE(decodesAStringSet)
+{
+    json users = {"alice", "bob", "carol", "bob"};
+    std::vector<uint8_t> cbor = json::to_cbor(users);
+    std::set<std::string> result;
+    CborStringSetDecoder decoder;
+    CHECK(decoder.decode(BufferView(cbor.data(), cbor.size()), result));
+    CHECK(result == std::set<std::string>({"alice", "bob", "carol"}));
+}
+
+TEST_CASE(stringSetSkipsItemsOfOtherTypes)
+{
+    json users = {"alice", 42, json::array({"nested"}), json::object({{"Username", "bob"}}), true};
+    std::vector<uint8_t> cbor = json::to_cbor(users);
+    std::set<std::string> result;
+    CborStringSetDecoder decoder;
+    CHECK(decoder.decode(BufferView(cbor.data(), cbor.size()), result));
+    CHECK(result == std::set<std::string>({"alice"}));
+}
+
+TEST_CASE(matchesNestedPaths)
+{
+    json user = {
+        {"Username", "alice"},
+        {"Count", 7},
+        {"Admin", true},
+        {"Negative", -3},
+        {"Ratio", 0.5},
+        {"Fingerprints", {
+            {{"Fingerprint", "aa"}, {"Name", "laptop"}},
+            {{"Fingerprint", "bb"}},
+        }},
+        {"Other", {{"Username", "not alice"}}},
+    };
+    std::vector<uint8_t> cbor = json::to_cbor(user);
+    FingerprintDecoder decoder;
+    CHECK(decoder.decode(BufferView(cbor.data(), cbor.size())));
+    CHECK(decoder.username_ == "alice");
+    CHECK(decoder.count_ == 7);
+    CHECK(decoder.admin_);
+    CHECK(decoder.maps_ == 2);
+    CHECK(decoder.fingerprints_ == std::vector<std::string>({"aa", "bb"}));
+}
+
+TEST_CASE(rejectsMalformedCbor)
+{
+    json users = {"alice", "bob"};
+    std::vector<uint8_t> cbor = json::to_cbor(users);
+    // cut inside the last string.
+    cbor.resize(cbor.size() - 1);
+    std::set<std::string> result;
+    CborStringSetDecoder decoder;
+    CHECK(!decoder.decode(BufferView(cbor.data(), cbor.size()), result));
+
+    std::vector<uint8_t> empty;
+    CHECK(!decoder.decode(BufferView(empty.data(), empty.size()), result));
+}
+
+TEST_CASE(decoderIsReusable)
+{
+    CborStringSetDecoder decoder;
+    std::vector<uint8_t> broken = {0x82, 0x61};
+    std::set<std::string> result;
+    CHECK(!decoder.decode(BufferView(broken.data(), broken.size()), result));
+
+    std::vector<uint8_t> cbor = json::to_cbor(json({"alice"}));
+    result.clear();
+    CHECK(decoder.decode(BufferView(cbor.data(), cbor.size()), result));
+    CHECK(result == std::set<std::string>({"alice"}));
+}
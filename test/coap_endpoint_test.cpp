@@ -0,0 +1,93 @@
+#include "test.hpp"
+
+#include <src/coap_endpoint.hpp>
+
+using json = nlohmann::json;
+
+static_assert(coapPathPlaceholders("/iam/users") == 0, "no placeholders");
+static_assert(coapPathPlaceholders("/iam/users/{}/role") == 1, "one placeholder");
+static_assert(coapPathPlaceholders("/{}/{}") == 2, "two placeholders");
+
+TEST_CASE(formatsPathsWithoutArguments)
+{
+    CHECK(coapFormatPath("/iam/users") == "/iam/users");
+}
+
+TEST_CASE(formatsPathArguments)
+{
+    std::string user = "alice";
+    std::string role = "Admin";
+    CHECK(coapFormatPath("/iam/users/{}", user) == "/iam/users/alice");
+    CHECK(coapFormatPath("/iam/users/{}/role/{}", user, role) == "/iam/users/alice/role/Admin");
+    CHECK(coapFormatPath("{}{}", user, role) == "aliceAdmin");
+    std::string empty;
+    CHECK(coapFormatPath("/iam/users/{}/role", empty) == "/iam/users//role");
+}
+
+TEST_CASE(formatsLongPathArguments)
+{
+    std::string user(300, 'u');
+    CHECK(coapFormatPath("/iam/users/{}/password", user) == "/iam/users/" + user + "/password");
+}
+
+static json roundTrip(const std::vector<uint8_t>& cbor)
+{
+    return json::from_cbor(cbor);
+}
+
+TEST_CASE(encodesStringsOfEachLength)
+{
+    for (size_t length : {0, 1, 23, 24, 255, 256, 65535, 65536, 70000}) {
+        std::string value(length, 'x');
+        std::vector<uint8_t> cbor;
+        encodeCbor(cbor, value);
+        CHECK(roundTrip(cbor) == json(value));
+    }
+}
+
+TEST_CASE(encodesTheShortestHead)
+{
+    std::vector<uint8_t> cbor;
+    cborHead(cbor, 3, 23);
+    CHECK(cbor == std::vector<uint8_t>({0x77}));
+    cbor.clear();
+    cborHead(cbor, 3, 24);
+    CHECK(cbor == std::vector<uint8_t>({0x78, 24}));
+    cbor.clear();
+    cborHead(cbor, 5, 256);
+    CHECK(cbor == std::vector<uint8_t>({0xb9, 0x01, 0x00}));
+    cbor.clear();
+    cborHead(cbor, 2, 65536);
+    CHECK(cbor == std::vector<uint8_t>({0x5a, 0x00, 0x01, 0x00, 0x00}));
+}
+
+TEST_CASE(encodesBooleans)
+{
+    std::vector<uint8_t> cbor;
+    encodeCbor(cbor, true);
+    CHECK(roundTrip(cbor) == json(true));
+    cbor.clear();
+    encodeCbor(cbor, false);
+    CHECK(roundTrip(cbor) == json(false));
+}
+
+TEST_CASE(encodedArraysAndMapsRoundTrip)
+{
+    std::vector<uint8_t> cbor;
+    cborHead(cbor, 4, 3);
+    encodeCbor(cbor, std::string("alice"));
+    encodeCbor(cbor, std::string("bob"));
+    encodeCbor(cbor, std::string("alice"));
+    CHECK(roundTrip(cbor) == json({"alice", "bob", "alice"}));
+
+    std::set<std::string> users;
+    CborStringSetDecoder decoder;
+    CHECK(decoder.decode(nabto::client::BufferView(cbor.data(), cbor.size()), users));
+    CHECK(users == std::set<std::string>({"alice", "bob"}));
+
+    cbor.clear();
+    cborHead(cbor, 5, 1);
+    encodeCbor(cbor, std::string("Username"));
+    encodeCbor(cbor, std::string("alice"));
+    CHECK(roundTrip(cbor) == json({{"Username", "alice"}}));
+}
@@ -0,0 +1,76 @@
+#include "test.hpp"
+
+#include <src/connect_strategy.hpp>
+
+using Channels = ConnectStrategy::Channels;
+
+static Configuration::DeviceInfo device(const std::string& deviceId)
+{
+    Configuration::DeviceInfo d;
+    d.productId_ = Configuration::InternedString("pr-test");
+    d.deviceId_ = Configuration::InternedString(deviceId);
+    return d;
+}
+
+TEST_CASE(unknownDeviceTriesAllChannels)
+{
+    ConnectStrategy strategy;
+    CHECK(strategy.plan(device("de-unknown")) == std::vector<Channels>({Channels::ANY}));
+    CHECK(strategy.plan(device("de-unknown"), true) == std::vector<Channels>({Channels::HEDGED}));
+}
+
+TEST_CASE(remoteOnlyDeviceFoundByAnAnyConnectSkipsMdns)
+{
+    ConnectStrategy strategy;
+    auto d = device("de-remote");
+    strategy.recordOutcome(d, Channels::ANY, true, std::chrono::milliseconds(300));
+    strategy.recordReachedChannels(d, false, true);
+    CHECK(strategy.plan(d) == std::vector<Channels>({Channels::REMOTE_ONLY, Channels::ANY}));
+}
+
+TEST_CASE(deviceReachedLocallyKeepsTryingAllChannels)
+{
+    ConnectStrategy strategy;
+    auto d = device("de-local");
+    strategy.recordOutcome(d, Channels::ANY, true, std::chrono::milliseconds(30));
+    strategy.recordReachedChannels(d, true, true);
+    CHECK(strategy.plan(d) == std::vector<Channels>({Channels::ANY}));
+}
+
+TEST_CASE(hedgedWinnerResumesItsChannels)
+{
+    ConnectStrategy strategy;
+    auto d = device("de-hedged");
+    // connectHedged reports the channel set of the winning connection.
+    strategy.recordOutcome(d, Channels::REMOTE_ONLY, true, std::chrono::milliseconds(300));
+    CHECK(strategy.plan(d, true) == std::vector<Channels>({Channels::REMOTE_ONLY, Channels::ANY}));
+}
+
+static Configuration::DirectCandidate candidate(const std::string& host)
+{
+    Configuration::DirectCandidate c;
+    c.host_ = host;
+    return c;
+}
+
+TEST_CASE(candidateStatsAreRankedFromMemory)
+{
+    ConnectStrategy strategy;
+    auto d = device("de-candidates");
+    d.directCandidates_ = {candidate("10.0.0.1"), candidate("10.0.0.2")};
+    CHECK(strategy.rankCandidates(d)[0].host_ == "10.0.0.1");
+
+    // the bookmark is not written, the ranking still follows the failure.
+    strategy.recordDirectCandidates(d, {d.directCandidates_[0]}, false, false, std::chrono::milliseconds(0));
+    auto ranked = strategy.rankCandidates(d);
+    CHECK(ranked[0].host_ == "10.0.0.2");
+    CHECK(ranked[1].failures_ == 1);
+    CHECK(d.directCandidates_[0].failures_ == 0);
+
+    strategy.recordDirectCandidates(d, {d.directCandidates_[0]}, true, true, std::chrono::milliseconds(40));
+    ranked = strategy.rankCandidates(d);
+    CHECK(ranked[0].host_ == "10.0.0.1");
+    CHECK(ranked[0].rttMs_ == 40);
+    CHECK(ranked[0].successes_ == 1);
+    CHECK(ranked[0].failures_ == 0);
+}
@@ -0,0 +1,154 @@
+#include "test.hpp"
+
+#include <nabto_client_coroutine.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using nabto::client::Connection;
+using nabto::client::Context;
+using nabto::client::Executor;
+using nabto::client::FutureVoid;
+using nabto::client::NabtoException;
+using nabto::client::PromiseVoid;
+using nabto::client::Status;
+using nabto::client::Task;
+
+// Resolves the promise from another thread after a while, like the SDK thread would.
+static void resolveLater(std::shared_ptr<PromiseVoid> promise, int ec)
+{
+    std::thread([promise, ec]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            promise->resolve(Status(ec));
+        }).detach();
+}
+
+static Task<int> addAfter(std::shared_ptr<FutureVoid> future, int a, int b)
+{
+    co_await future;
+    co_return a + b;
+}
+
+static Task<int> nested(std::shared_ptr<PromiseVoid> first, std::shared_ptr<PromiseVoid> second)
+{
+    int x = co_await addAfter(first->getFuture(), 1, 2);
+    int y = co_await addAfter(second->getFuture(), x, 4);
+    co_return y;
+}
+
+static Task<int> errorOf(std::shared_ptr<FutureVoid> future)
+{
+    try {
+        co_await future;
+    } catch (NabtoException& e) {
+        co_return e.status().getErrorCode();
+    }
+    co_return Status::OK;
+}
+
+TEST_CASE(taskAwaitsAFutureResolvedOnAnotherThread)
+{
+    auto promise = PromiseVoid::create();
+    auto task = addAfter(promise->getFuture(), 2, 3);
+    resolveLater(promise, Status::OK);
+    CHECK(task.wait() == 5);
+}
+
+TEST_CASE(taskAwaitsAResolvedFutureWithoutSuspending)
+{
+    auto promise = PromiseVoid::create();
+    promise->resolve(Status(Status::OK));
+    CHECK(addAfter(promise->getFuture(), 1, 1).wait() == 2);
+}
+
+TEST_CASE(tasksAwaitOtherTasks)
+{
+    auto first = PromiseVoid::create();
+    auto second = PromiseVoid::create();
+    auto task = nested(first, second);
+    resolveLater(first, Status::OK);
+    resolveLater(second, Status::OK);
+    CHECK(task.wait() == 7);
+}
+
+TEST_CASE(failedFutureThrowsFromTheAwait)
+{
+    auto promise = PromiseVoid::create();
+    auto task = errorOf(promise->getFuture());
+    resolveLater(promise, Status::FORBIDDEN);
+    CHECK(task.wait() == Status::FORBIDDEN);
+}
+
+TEST_CASE(waitRethrowsTheExceptionOfTheTask)
+{
+    auto promise = PromiseVoid::create();
+    auto task = addAfter(promise->getFuture(), 1, 1);
+    resolveLater(promise, Status::TIMEOUT);
+    int ec = Status::OK;
+    try {
+        task.wait();
+    } catch (NabtoException& e) {
+        ec = e.status().getErrorCode();
+    }
+    CHECK(ec == Status::TIMEOUT);
+}
+
+TEST_CASE(startedTaskReportsWhenItIsDone)
+{
+    auto promise = PromiseVoid::create();
+    std::promise<bool> done;
+    auto finished = done.get_future();
+    addAfter(promise->getFuture(), 1, 1).start([&done](std::exception_ptr error) { done.set_value(error == nullptr); });
+    CHECK(finished.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout);
+    resolveLater(promise, Status::OK);
+    CHECK(finished.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(finished.get());
+}
+
+static Task<std::thread::id> threadAfter(std::shared_ptr<FutureVoid> future, std::shared_ptr<Executor> executor)
+{
+    co_await nabto::client::resumeOn(future, executor);
+    co_return std::this_thread::get_id();
+}
+
+TEST_CASE(resumeOnContinuesOnTheExecutor)
+{
+    auto pool = Executor::createThreadPool(1);
+    std::promise<std::thread::id> poolThread;
+    pool->post([&poolThread]() { poolThread.set_value(std::this_thread::get_id()); });
+    auto promise = PromiseVoid::create();
+    auto task = threadAfter(promise->getFuture(), pool);
+    resolveLater(promise, Status::OK);
+    CHECK(task.wait() == poolThread.get_future().get());
+}
+
+static Task<void> reportConnectError(std::shared_ptr<Connection> connection, std::shared_ptr<std::promise<int> > result)
+{
+    int ec = Status::OK;
+    try {
+        co_await connection->connect();
+    } catch (NabtoException& e) {
+        ec = e.status().getErrorCode();
+    }
+    result->set_value(ec);
+}
+
+TEST_CASE(taskAwaitsAnSdkFutureFromAnSdkCallback)
+{
+    // without a product and device id the connects fail on the SDK thread.
+    auto context = Context::create();
+    auto first = context->createConnection();
+    auto second = context->createConnection();
+    auto result = std::make_shared<std::promise<int> >();
+    auto finished = result->get_future();
+    first->connect()->onResult([second, result](Status) {
+            // the SDK refuses to wait on its callback thread, the await has to suspend.
+            reportConnectError(second, result).start();
+        }, nullptr);
+    CHECK(finished.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    int ec = finished.get();
+    CHECK(ec != Status::FUTURE_NOT_RESOLVED);
+    CHECK(ec != Status::COULD_BLOCK);
+}
@@ -0,0 +1,103 @@
+#include "test.hpp"
+
+#include <nabto_client.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using nabto::client::Executor;
+
+TEST_CASE(threadPoolFinishesQueuedWorkBeforeStopping)
+{
+    std::atomic<int> done(0);
+    {
+        auto pool = Executor::createThreadPool(2);
+        for (int i = 0; i < 100; i++) {
+            pool->post([&done]() {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                done++;
+            });
+        }
+    }
+    CHECK(done == 100);
+}
+
+TEST_CASE(threadPoolDestroyedFromItsOwnThread)
+{
+    for (int i = 0; i < 20; i++) {
+        std::promise<void> dropped;
+        std::promise<void> released;
+        auto finished = released.get_future();
+        auto pool = Executor::createThreadPool(2);
+        auto self = pool;
+        std::shared_future<void> go = dropped.get_future().share();
+        // the work holds the last reference to the pool when it resets it.
+        pool->post([self, go, &released]() mutable {
+            go.wait();
+            self.reset();
+            released.set_value();
+        });
+        self.reset();
+        pool.reset();
+        dropped.set_value();
+        CHECK(finished.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+    // let the detached threads end before the next test.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST_CASE(threadPoolDestroyedByTheCapturesOfItsWork)
+{
+    for (int i = 0; i < 20; i++) {
+        std::promise<void> dropped;
+        std::promise<void> ran;
+        auto finished = ran.get_future();
+        auto pool = Executor::createThreadPool(1);
+        auto self = pool;
+        std::shared_future<void> go = dropped.get_future().share();
+        // the pool is destroyed when the finished work is freed on the pool thread.
+        pool->post([self, go, &ran]() {
+            go.wait();
+            ran.set_value();
+        });
+        self.reset();
+        pool.reset();
+        dropped.set_value();
+        CHECK(finished.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST_CASE(strandRunsWorkOneAtATimeInOrder)
+{
+    auto pool = Executor::createThreadPool(4);
+    auto strand = Executor::createStrand(pool);
+    std::atomic<int> running(0);
+    std::atomic<bool> overlapped(false);
+    std::vector<int> order;
+    std::promise<void> allDone;
+    auto finished = allDone.get_future();
+    const int count = 200;
+    for (int i = 0; i < count; i++) {
+        strand->post([&, i]() {
+            if (running++ != 0) {
+                overlapped = true;
+            }
+            order.push_back(i);
+            running--;
+            if (i == count - 1) {
+                allDone.set_value();
+            }
+        });
+    }
+    CHECK(finished.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(!overlapped);
+    CHECK(order.size() == count);
+    bool inOrder = true;
+    for (size_t i = 0; i < order.size(); i++) {
+        inOrder = inOrder && order[i] == static_cast<int>(i);
+    }
+    CHECK(inOrder);
+}
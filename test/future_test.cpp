@@ -0,0 +1,167 @@
+#include "test.hpp"
+
+#include <nabto_client.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+using nabto::client::Future;
+using nabto::client::FutureSize;
+using nabto::client::FutureVoid;
+using nabto::client::NabtoException;
+using nabto::client::PromiseVoid;
+using nabto::client::Status;
+
+// The error code a future resolved with, OK if it succeeded.
+static int errorOf(std::shared_ptr<FutureVoid> future)
+{
+    try {
+        future->waitForResult();
+    } catch (NabtoException& e) {
+        return e.status().getErrorCode();
+    }
+    return Status::OK;
+}
+
+TEST_CASE(thenResolvesWithTheFollowingFuture)
+{
+    auto first = PromiseVoid::create();
+    auto second = PromiseVoid::create();
+    int seen = -1;
+    auto result = first->getFuture()->then([&seen, second](Status status) -> std::shared_ptr<Future> {
+            seen = status.getErrorCode();
+            return second->getFuture();
+        });
+    first->resolve(Status(Status::OK));
+    CHECK(seen == Status::OK);
+    CHECK(!result->waitFor(0));
+    second->resolve(Status(Status::FORBIDDEN));
+    CHECK(errorOf(result) == Status::FORBIDDEN);
+}
+
+TEST_CASE(thenWithoutAFollowingFutureKeepsTheStatus)
+{
+    auto first = PromiseVoid::create();
+    auto result = first->getFuture()->then([](Status) -> std::shared_ptr<Future> { return nullptr; });
+    first->resolve(Status(Status::TIMEOUT));
+    CHECK(errorOf(result) == Status::TIMEOUT);
+}
+
+TEST_CASE(thenFailsIfNextThrows)
+{
+    auto first = PromiseVoid::create();
+    auto nabtoError = first->getFuture()->then([](Status) -> std::shared_ptr<Future> {
+            throw NabtoException(Status::NOT_FOUND);
+        });
+    first->resolve(Status(Status::OK));
+    CHECK(errorOf(nabtoError) == Status::NOT_FOUND);
+
+    auto second = PromiseVoid::create();
+    auto otherError = second->getFuture()->then([](Status) -> std::shared_ptr<Future> {
+            throw std::runtime_error("not a NabtoException");
+        });
+    second->resolve(Status(Status::OK));
+    int ec = errorOf(otherError);
+    CHECK(ec != Status::OK);
+}
+
+TEST_CASE(whenAllWaitsForEveryFuture)
+{
+    auto a = PromiseVoid::create();
+    auto b = PromiseVoid::create();
+    auto c = PromiseVoid::create();
+    auto all = Future::whenAll({a->getFuture(), b->getFuture(), c->getFuture()});
+    a->resolve(Status(Status::OK));
+    b->resolve(Status(Status::OK));
+    CHECK(!all->waitFor(0));
+    c->resolve(Status(Status::OK));
+    CHECK(errorOf(all) == Status::OK);
+}
+
+TEST_CASE(whenAllReportsTheFirstError)
+{
+    auto a = PromiseVoid::create();
+    auto b = PromiseVoid::create();
+    auto c = PromiseVoid::create();
+    auto all = Future::whenAll({a->getFuture(), b->getFuture(), c->getFuture()});
+    b->resolve(Status(Status::FORBIDDEN));
+    // an error does not resolve it early.
+    CHECK(!all->waitFor(0));
+    a->resolve(Status(Status::TIMEOUT));
+    c->resolve(Status(Status::OK));
+    CHECK(errorOf(all) == Status::FORBIDDEN);
+
+    CHECK(errorOf(Future::whenAll({})) == Status::OK);
+}
+
+TEST_CASE(whenAnyPicksTheFirstSuccessAndCancelsTheRest)
+{
+    auto a = PromiseVoid::create();
+    auto b = PromiseVoid::create();
+    auto c = PromiseVoid::create();
+    std::vector<int> cancelled;
+    auto any = Future::whenAny({a->getFuture(), b->getFuture(), c->getFuture()}, {
+            [&cancelled]() { cancelled.push_back(0); },
+            [&cancelled]() { cancelled.push_back(1); },
+            [&cancelled]() { cancelled.push_back(2); }
+        });
+    a->resolve(Status(Status::TIMEOUT));
+    CHECK(!any->waitFor(0));
+    c->resolve(Status(Status::OK));
+    CHECK(any->waitForResult() == 2);
+    // only the unresolved future is cancelled.
+    CHECK(cancelled == std::vector<int>({1}));
+    b->resolve(Status(Status::OK));
+    CHECK(any->getResult() == 2);
+}
+
+TEST_CASE(whenAnyFailsWithTheLastError)
+{
+    auto a = PromiseVoid::create();
+    auto b = PromiseVoid::create();
+    auto any = Future::whenAny({a->getFuture(), b->getFuture()});
+    a->resolve(Status(Status::TIMEOUT));
+    b->resolve(Status(Status::FORBIDDEN));
+    int ec = Status::OK;
+    try {
+        any->waitForResult();
+    } catch (NabtoException& e) {
+        ec = e.status().getErrorCode();
+    }
+    CHECK(ec == Status::FORBIDDEN);
+}
+
+TEST_CASE(withTimeoutCancelsASlowFuture)
+{
+    auto slow = PromiseVoid::create();
+    std::atomic<bool> cancelled(false);
+    auto start = std::chrono::steady_clock::now();
+    auto limited = Future::withTimeout(slow->getFuture(), 50, [&cancelled]() { cancelled = true; });
+    CHECK(errorOf(limited) == Status::TIMEOUT);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+    CHECK(cancelled);
+    // resolving it later does not change the result.
+    slow->resolve(Status(Status::OK));
+    CHECK(errorOf(limited) == Status::TIMEOUT);
+}
+
+TEST_CASE(withTimeoutKeepsTheStatusOfAFastFuture)
+{
+    auto fast = PromiseVoid::create();
+    std::atomic<bool> cancelled(false);
+    auto limited = Future::withTimeout(fast->getFuture(), 50, [&cancelled]() { cancelled = true; });
+    fast->resolve(Status(Status::FORBIDDEN));
+    CHECK(errorOf(limited) == Status::FORBIDDEN);
+    // the timer still fires, it must not cancel a resolved future.
+    Future::timer(100)->waitForResult();
+    CHECK(!cancelled);
+}
+
+TEST_CASE(timerResolvesAfterItsTime)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto timer = Future::timer(30);
+    CHECK(errorOf(timer) == Status::OK);
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(30));
+}
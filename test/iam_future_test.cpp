@@ -0,0 +1,32 @@
+#include "test.hpp"
+
+#include <src/iam.hpp>
+
+using nabto::client::NabtoException;
+using nabto::client::Status;
+
+typedef IAM::IAMFuture<std::pair<int, std::unique_ptr<std::string> > > Future;
+
+static int errorOfGetResult(Future& future)
+{
+    try {
+        future.getResult();
+    } catch (NabtoException& e) {
+        return e.status().getErrorCode();
+    }
+    return Status::OK;
+}
+
+TEST_CASE(resultIsTakenOnce)
+{
+    Future future;
+    CHECK(!future.getFuture()->waitFor(0));
+    CHECK(errorOfGetResult(future) == Status::FUTURE_NOT_RESOLVED);
+
+    future.resolve(std::make_pair(42, std::unique_ptr<std::string>(new std::string("alice"))));
+    CHECK(future.getFuture()->waitFor(0));
+    auto result = future.waitForResult();
+    CHECK(result.first == 42);
+    CHECK(result.second && *result.second == "alice");
+    CHECK(errorOfGetResult(future) == Status::INVALID_STATE);
+}
@@ -0,0 +1,40 @@
+#include "test.hpp"
+
+#include <src/scanner.hpp>
+
+using nabto::examples::common::ScanDeadline;
+using std::chrono::milliseconds;
+
+TEST_CASE(scanDeadlineWithoutDevices)
+{
+    auto start = ScanDeadline::clock::now();
+    ScanDeadline deadline(start, milliseconds(2000), milliseconds(300));
+    CHECK(deadline.get() == start + milliseconds(2000));
+}
+
+TEST_CASE(scanDeadlineFollowsTheLastNewDevice)
+{
+    auto start = ScanDeadline::clock::now();
+    ScanDeadline deadline(start, milliseconds(2000), milliseconds(300));
+    deadline.deviceFound(start + milliseconds(100));
+    CHECK(deadline.get() == start + milliseconds(400));
+    // a later device extends the scan, it does not only shrink it.
+    deadline.deviceFound(start + milliseconds(350));
+    CHECK(deadline.get() == start + milliseconds(650));
+}
+
+TEST_CASE(scanDeadlineIsCappedByTheTimeout)
+{
+    auto start = ScanDeadline::clock::now();
+    ScanDeadline deadline(start, milliseconds(2000), milliseconds(300));
+    deadline.deviceFound(start + milliseconds(1900));
+    CHECK(deadline.get() == start + milliseconds(2000));
+}
+
+TEST_CASE(scanDeadlineWithoutIdleTimeout)
+{
+    auto start = ScanDeadline::clock::now();
+    ScanDeadline deadline(start, milliseconds(2000), milliseconds(0));
+    deadline.deviceFound(start + milliseconds(100));
+    CHECK(deadline.get() == start + milliseconds(2000));
+}
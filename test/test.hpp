@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A minimal test runner, a test executable is a number of TEST_CASEs
+ * and test_main.cpp. CHECK records a failure and continues, such that
+ * one run reports every failing check.
+ */
+namespace test {
+
+class Registry {
+ public:
+    typedef std::pair<std::string, std::function<void ()> > TestCase;
+
+    static std::vector<TestCase>& tests()
+    {
+        static std::vector<TestCase> t;
+        return t;
+    }
+
+    static int& failures()
+    {
+        static int f = 0;
+        return f;
+    }
+};
+
+class Registrar {
+ public:
+    Registrar(const char* name, std::function<void ()> test)
+    {
+        Registry::tests().push_back(std::make_pair(std::string(name), test));
+    }
+};
+
+inline void fail(const char* file, int line, const char* expression)
+{
+    std::cerr << file << ":" << line << ": CHECK(" << expression << ") failed" << std::endl;
+    Registry::failures()++;
+}
+
+int runAll();
+
+} // namespace
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static test::Registrar name##Registrar(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            test::fail(__FILE__, __LINE__, #expression); \
+        } \
+    } while (0)
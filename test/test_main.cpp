@@ -0,0 +1,16 @@
+#include "test.hpp"
+
+int test::runAll()
+{
+    for (auto& t : Registry::tests()) {
+        int before = Registry::failures();
+        t.second();
+        std::cout << (Registry::failures() == before ? "PASS " : "FAIL ") << t.first << std::endl;
+    }
+    return Registry::failures() == 0 ? 0 : 1;
+}
+
+int main()
+{
+    return test::runAll();
+}